@@ -0,0 +1,447 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "fmon.h"
+#include "attach.h"
+#include "crawler.h"
+#include "notify.h"
+#include "statcache.h"
+#include "watcher.h"
+
+#include <string.h>
+
+/*
+ * The subtree of a new directory is attached from an idle source, a slice of
+ * directories at a time, so a large copy into a watched tree does not stall
+ * the other watchers. Each directory is watched before being read: an entry
+ * created meanwhile is either found by the crawl or reported by the watch.
+ * The events received for the subtree are held until the crawl ends, then
+ * the entries found get a created event and the held events are processed.
+ * The held events already reported by the crawl are dropped.
+ *
+ * The initial crawl of a watcher runs the same way, breadth first so the
+ * shallow directories are watched first, after the pending attachments and
+ * the initial crawls of the watchers with a higher priority. It neither holds
+ * nor reports events.
+ */
+
+static gboolean
+attach_prune(const gchar *path, gpointer user_data)
+{
+  return watcher_is_pruned(((attach_t *) user_data)->watcher, path);
+}
+
+static gboolean
+attach_directory(const gchar *path, guint depth, gpointer user_data)
+{
+  attach_t *attach = (attach_t *) user_data;
+
+  if (!watcher_add_monitor_for_path(attach->watcher, path))
+    return FALSE;
+
+  /* the root of the subtree has its own event */
+  if (!attach->initial && (depth > attach->depth))
+    g_ptr_array_add(attach->entries, g_strdup(path));
+
+  return TRUE;
+}
+
+static gboolean
+attach_entry(const gchar *path, guint depth, gpointer user_data)
+{
+  g_ptr_array_add(((attach_t *) user_data)->entries, g_strdup(path));
+
+  return TRUE;
+}
+
+static void
+attach_free(attach_t *attach)
+{
+  attach_event_t *event;
+
+  while ((event = g_queue_pop_head(&attach->events)) != NULL)
+    {
+      g_free(event->file);
+      g_free(event);
+    }
+
+  crawler_job_free(attach->job);
+  if (attach->entries)
+    g_ptr_array_free(attach->entries, TRUE);
+  g_free(attach->path);
+  g_free(attach);
+}
+
+static gboolean
+attach_forget_synthetics(gpointer user_data)
+{
+  watcher_t *watcher = (watcher_t *) user_data;
+
+  g_hash_table_remove_all(watcher->synthetics);
+  watcher->synthetics_source = 0;
+
+  return FALSE;
+}
+
+static void
+attach_finish(attach_t *attach)
+{
+  watcher_t *watcher;
+  attach_event_t *event;
+  const gchar *entry;
+  guint i;
+
+  watcher = attach->watcher;
+
+  LOG_DEBUG("%s: %s (path=%s, directories=%u, entries=%u, held=%u, "
+      "time=%" G_GINT64_FORMAT "ms)",
+      watcher->name, N_("subtree attached"), attach->path,
+      attach->job->directories, attach->entries->len, attach->events.length,
+      (g_get_monotonic_time() - attach->started) / 1000);
+
+  if (attach->entries->len > 0)
+    {
+      if (!watcher->synthetics)
+        watcher->synthetics = g_hash_table_new_full(g_str_hash, g_str_equal,
+            g_free, NULL);
+
+      for (i = 0; i < attach->entries->len; i++)
+        {
+          entry = (const gchar *) g_ptr_array_index(attach->entries, i);
+
+          statcache_forget(entry);
+
+          watcher_event_deliver(watcher, entry, G_FILE_MONITOR_EVENT_CREATED);
+
+          g_hash_table_add(watcher->synthetics, g_strdup(entry));
+        }
+
+      if (watcher->synthetics_source)
+        g_source_remove(watcher->synthetics_source);
+
+      watcher->synthetics_source = g_timeout_add(ATTACH_SYNTHETICS_DELAY,
+          attach_forget_synthetics, watcher);
+    }
+
+  while ((event = g_queue_pop_head(&attach->events)) != NULL)
+    {
+      watcher_event_process(watcher, event->file, event->event_type);
+
+      g_free(event->file);
+      g_free(event);
+    }
+
+  attach_free(attach);
+}
+
+static gboolean
+attach_idle(gpointer user_data);
+
+static gboolean
+attach_crawl_is_held(const watcher_t *watcher)
+{
+  const watcher_t *other;
+  GSList *item;
+
+  /* the watchers with a higher priority claim the watch budget first */
+  for (item = app->watchers; item; item = item->next)
+    {
+      other = (const watcher_t *) item->data;
+
+      if (other->crawl && (other->priority > watcher->priority))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+attach_crawl_done(attach_t *attach)
+{
+  watcher_t *watcher, *other;
+  GSList *item;
+
+  watcher = attach->watcher;
+  watcher->crawled = attach->job->directories;
+  watcher->crawl_time = (g_get_monotonic_time() - attach->started) / 1000;
+
+  LOG_INFO("%s: %s (directories=%" G_GUINT64_FORMAT ", time=%"
+      G_GINT64_FORMAT "ms)",
+      watcher->name, N_("initial crawl done"), watcher->crawled,
+      watcher->crawl_time);
+
+  attach_free(attach);
+
+  for (item = app->watchers; item; item = item->next)
+    {
+      other = (watcher_t *) item->data;
+
+      if (other->crawl && !other->attach_source)
+        other->attach_source = g_idle_add(attach_idle, other);
+    }
+
+  notify_crawl_done();
+}
+
+static gboolean
+attach_idle(gpointer user_data)
+{
+  watcher_t *watcher;
+  attach_t *attach;
+  gint64 now;
+
+  watcher = (watcher_t *) user_data;
+
+  statcache_begin();
+
+  attach = g_queue_peek_head(&watcher->attaches);
+  if (attach)
+    {
+      if (crawler_job_step(attach->job, ATTACH_SLICE))
+        return TRUE;
+
+      /* the held events may start other attachments */
+      g_queue_pop_head(&watcher->attaches);
+
+      attach_finish(attach);
+    }
+  else if (watcher->crawl && !attach_crawl_is_held(watcher))
+    {
+      attach = watcher->crawl;
+
+      /* each crawler thread reads a slice of the current level */
+      if (crawler_job_step(attach->job, ATTACH_SLICE * attach->job->threads))
+        {
+          now = g_get_monotonic_time() / 1000;
+          if (now - attach->progress >= ATTACH_PROGRESS_DELAY)
+            {
+              attach->progress = now;
+
+              attach_list(watcher);
+            }
+
+          return TRUE;
+        }
+
+      watcher->crawl = NULL;
+
+      attach_crawl_done(attach);
+    }
+
+  if (!g_queue_is_empty(&watcher->attaches)
+      || (watcher->crawl && !attach_crawl_is_held(watcher)))
+    return TRUE;
+
+  watcher->attach_source = 0;
+
+  return FALSE;
+}
+
+gboolean
+attach_crawl(watcher_t *watcher)
+{
+  attach_t *attach;
+
+  if (watcher_is_pruned(watcher, watcher->path))
+    return FALSE;
+
+  attach = g_new0(attach_t, 1);
+  attach->watcher = watcher;
+  attach->path = g_strdup(watcher->path);
+  attach->len = strlen(watcher->path);
+  attach->depth = 1;
+  attach->initial = TRUE;
+  attach->started = g_get_monotonic_time();
+  attach->progress = attach->started / 1000;
+  g_queue_init(&attach->events);
+
+  attach->job = crawler_job_new(watcher->path, 1, watcher->maxdepth,
+      watcher->mount, app->crawler_threads, attach_prune, attach_directory,
+      NULL, attach);
+  if (!attach->job)
+    {
+      attach_free(attach);
+
+      return FALSE;
+    }
+
+  /* the watcher path itself is watched at once */
+  crawler_job_step(attach->job, 1);
+
+  watcher->crawled = 0;
+  watcher->crawl = attach;
+
+  notify_crawl_started();
+
+  if (!watcher->attach_source)
+    watcher->attach_source = g_idle_add(attach_idle, watcher);
+
+  return TRUE;
+}
+
+void
+attach_start(watcher_t *watcher, const gchar *path, guint depth)
+{
+  attach_t *attach;
+
+  if ((watcher->maxdepth > 0) && (depth > watcher->maxdepth))
+    {
+      LOG_DEBUG("%s: %s (depth=%d, path=%s)",
+          watcher->name, N_("maximum depth of recursion reached"), depth, path);
+
+      return;
+    }
+
+  if (watcher_is_pruned(watcher, path))
+    return;
+
+  attach = g_new0(attach_t, 1);
+  attach->watcher = watcher;
+  attach->path = g_strdup(path);
+  attach->len = strlen(path);
+  attach->depth = depth;
+  attach->entries = g_ptr_array_new_with_free_func(g_free);
+  attach->started = g_get_monotonic_time();
+  g_queue_init(&attach->events);
+
+  attach->job = crawler_job_new(path, depth, watcher->maxdepth,
+      watcher->mount, 1, attach_prune, attach_directory, attach_entry, attach);
+  if (!attach->job)
+    {
+      attach_free(attach);
+
+      return;
+    }
+
+  /* the new directory itself is watched at once */
+  crawler_job_step(attach->job, 1);
+
+  g_queue_push_tail(&watcher->attaches, attach);
+
+  if (!watcher->attach_source)
+    watcher->attach_source = g_idle_add(attach_idle, watcher);
+}
+
+gboolean
+attach_buffer(watcher_t *watcher, const gchar *file,
+    GFileMonitorEvent event_type)
+{
+  attach_event_t *event;
+  attach_t *attach;
+  GList *link;
+
+  for (link = watcher->attaches.head; link; link = link->next)
+    {
+      attach = (attach_t *) link->data;
+
+      if ((strncmp(file, attach->path, attach->len) != 0)
+          || ((file[attach->len] != '\0')
+              && (file[attach->len] != G_DIR_SEPARATOR)))
+        continue;
+
+      event = g_new(attach_event_t, 1);
+      event->file = g_strdup(file);
+      event->event_type = event_type;
+
+      g_queue_push_tail(&attach->events, event);
+
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+gboolean
+attach_is_synthetic(watcher_t *watcher, const gchar *file,
+    GFileMonitorEvent event_type)
+{
+  if (!watcher->synthetics || !g_hash_table_size(watcher->synthetics))
+    return FALSE;
+
+  /* a deleted entry may be created again and must then be reported */
+  if (event_type == G_FILE_MONITOR_EVENT_DELETED)
+    {
+      g_hash_table_remove(watcher->synthetics, file);
+
+      return FALSE;
+    }
+
+  if (event_type != G_FILE_MONITOR_EVENT_CREATED)
+    return FALSE;
+
+  return g_hash_table_remove(watcher->synthetics, file);
+}
+
+void
+attach_cancel(watcher_t *watcher)
+{
+  attach_t *attach;
+
+  if (watcher->attach_source)
+    {
+      g_source_remove(watcher->attach_source);
+      watcher->attach_source = 0;
+    }
+
+  while ((attach = g_queue_pop_head(&watcher->attaches)) != NULL)
+    attach_free(attach);
+
+  if (watcher->crawl)
+    {
+      attach_free(watcher->crawl);
+      watcher->crawl = NULL;
+    }
+
+  if (watcher->synthetics_source)
+    {
+      g_source_remove(watcher->synthetics_source);
+      watcher->synthetics_source = 0;
+    }
+
+  if (watcher->synthetics)
+    {
+      g_hash_table_destroy(watcher->synthetics);
+      watcher->synthetics = NULL;
+    }
+}
+
+void
+attach_list(const watcher_t *watcher)
+{
+  const attach_t *attach;
+
+  attach = watcher->crawl;
+  if (attach)
+    {
+      LOG_INFO("%s: %s (directories=%u, pending=%u, time=%" G_GINT64_FORMAT
+          "ms, attachments=%u)",
+          watcher->name, N_("initial crawl in progress"),
+          attach->job->directories, attach->job->tasks.length,
+          (g_get_monotonic_time() - attach->started) / 1000,
+          watcher->attaches.length);
+    }
+  else
+    {
+      LOG_INFO("%s: %s (directories=%" G_GUINT64_FORMAT ", time=%"
+          G_GINT64_FORMAT "ms, attachments=%u)",
+          watcher->name, N_("initial crawl done"), watcher->crawled,
+          watcher->crawl_time, watcher->attaches.length);
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef ATTACH_H_
+#define ATTACH_H_
+
+#include "common.h"
+
+struct _watcher_t;
+struct _crawler_job_t;
+
+typedef struct _attach_event_t
+{
+  gchar *file;
+  GFileMonitorEvent event_type;
+} attach_event_t;
+
+typedef struct _attach_t
+{
+  struct _watcher_t *watcher;
+  gchar *path;
+  gsize len;
+  guint depth;
+  struct _crawler_job_t *job;
+  GPtrArray *entries;
+  GQueue events;
+  gboolean initial;
+  gint64 started;
+  gint64 progress;
+#define ATTACH_SLICE                    64
+#define ATTACH_SYNTHETICS_DELAY         2000
+#define ATTACH_PROGRESS_DELAY           5000
+} attach_t;
+
+gboolean
+attach_crawl(struct _watcher_t *watcher);
+void
+attach_start(struct _watcher_t *watcher, const gchar *path, guint depth);
+gboolean
+attach_buffer(struct _watcher_t *watcher, const gchar *file,
+    GFileMonitorEvent event_type);
+gboolean
+attach_is_synthetic(struct _watcher_t *watcher, const gchar *file,
+    GFileMonitorEvent event_type);
+void
+attach_cancel(struct _watcher_t *watcher);
+void
+attach_list(const struct _watcher_t *watcher);
+
+#endif /* ATTACH_H_ */
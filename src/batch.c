@@ -0,0 +1,123 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "fmon.h"
+#include "batch.h"
+#include "command.h"
+#include "jobs.h"
+#include "watcher.h"
+
+static gboolean
+batch_timeout(gpointer user_data)
+{
+  batch_t *batch;
+
+  batch = (batch_t *) user_data;
+  batch->source = 0;
+
+  batch_flush(batch);
+
+  return FALSE;
+}
+
+batch_t *
+batch_new(watcher_t *watcher)
+{
+  batch_t *batch;
+
+  batch = g_new0(batch_t, 1);
+  batch->watcher = watcher;
+  batch->records = g_string_new(NULL);
+
+  return batch;
+}
+
+void
+batch_free(batch_t *batch)
+{
+  if (!batch)
+    return;
+
+  /* the last batch waiting for a job slot is drained by jobs_free(), or
+   * dropped on exit with its number of events logged */
+  batch_flush(batch);
+
+  g_string_free(batch->records, TRUE);
+  g_free(batch);
+}
+
+void
+batch_add(batch_t *batch, const watcher_event_t *event)
+{
+  watcher_t *watcher;
+
+  watcher = batch->watcher;
+
+  g_string_append(batch->records, event->event);
+  g_string_append_c(batch->records, '\t');
+  g_string_append(batch->records, event->file);
+  g_string_append_c(batch->records, watcher->exec_batch0 ? '\0' : '\n');
+
+  batch->count++;
+
+  if (batch->count >= watcher->exec_batch)
+    {
+      batch_flush(batch);
+
+      return;
+    }
+
+  if (!batch->source)
+    batch->source = g_timeout_add(watcher->exec_batch_delay, batch_timeout,
+        batch);
+}
+
+void
+batch_flush(batch_t *batch)
+{
+  watcher_t *watcher;
+  gchar **argv;
+  gchar *line;
+
+  watcher = batch->watcher;
+
+  if (batch->source)
+    {
+      g_source_remove(batch->source);
+      batch->source = 0;
+    }
+
+  if (!batch->count)
+    return;
+
+  argv = command_expand(watcher->command, watcher, NULL);
+
+  line = g_strjoinv(" ", argv);
+  LOG_INFO("%s: %s '%s' (events=%d)",
+      watcher->name, N_("executing command"), line, batch->count);
+  g_free(line);
+
+  /* the job owns the records written on the command input, and the batches
+   * run in order as they may hold the same files */
+  jobs_run(watcher->jobs, "", argv, batch->records);
+
+  batch->records = g_string_new(NULL);
+  batch->count = 0;
+}
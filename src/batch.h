@@ -0,0 +1,46 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include "common.h"
+
+struct _watcher_t;
+struct _watcher_event_t;
+
+typedef struct _batch_t
+{
+  struct _watcher_t *watcher;
+  GString *records;
+  guint count;
+  guint source;
+} batch_t;
+
+batch_t *
+batch_new(struct _watcher_t *watcher);
+void
+batch_free(batch_t *batch);
+void
+batch_add(batch_t *batch, const struct _watcher_event_t *event);
+void
+batch_flush(batch_t *batch);
+
+#endif /* BATCH_H_ */
@@ -0,0 +1,251 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "fmon.h"
+#include "coalesce.h"
+#include "queue.h"
+#include "statcache.h"
+#include "watcher.h"
+
+/*
+ * Pending events are kept per file and merged until the file stays quiet for
+ * the coalesce delay. The deadlines are stored on a timer wheel whose slots
+ * cover a fraction of the delay, so rearming a busy file and expiring the
+ * quiet ones are constant time operations.
+ */
+
+static gboolean
+coalesce_timeout(gpointer user_data);
+
+static GFileMonitorEvent
+coalesce_merge(GFileMonitorEvent pending, GFileMonitorEvent event_type,
+    gboolean *cancel)
+{
+  *cancel = FALSE;
+
+  if (event_type == G_FILE_MONITOR_EVENT_DELETED)
+    {
+      /* a file created and deleted in the window never existed */
+      if (pending == G_FILE_MONITOR_EVENT_CREATED)
+        *cancel = TRUE;
+
+      return G_FILE_MONITOR_EVENT_DELETED;
+    }
+
+  if ((event_type == G_FILE_MONITOR_EVENT_CREATED)
+      || (pending == G_FILE_MONITOR_EVENT_CREATED))
+    return G_FILE_MONITOR_EVENT_CREATED;
+
+  if (pending == G_FILE_MONITOR_EVENT_DELETED)
+    return event_type;
+
+  if ((event_type == G_FILE_MONITOR_EVENT_CHANGED)
+      || (pending == G_FILE_MONITOR_EVENT_CHANGED))
+    return G_FILE_MONITOR_EVENT_CHANGED;
+
+  if ((event_type == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
+      || (pending == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT))
+    return G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT;
+
+  return event_type;
+}
+
+static gint64
+coalesce_get_tick(coalesce_t *coalesce)
+{
+  return g_get_monotonic_time() / 1000 / coalesce->tick;
+}
+
+static void
+coalesce_schedule(coalesce_t *coalesce, coalesce_entry_t *entry)
+{
+  gint64 now;
+
+  now = g_get_monotonic_time() / 1000;
+
+  /* the entry expires on the first tick after the delay */
+  entry->tick = (now + coalesce->delay + coalesce->tick - 1) / coalesce->tick;
+
+  g_queue_push_tail_link(&coalesce->wheel[entry->tick % COALESCE_WHEEL_SIZE],
+      &entry->link);
+
+  if (!coalesce->source)
+    {
+      coalesce->cursor = now / coalesce->tick;
+      coalesce->source = g_timeout_add(coalesce->tick, coalesce_timeout,
+          coalesce);
+    }
+}
+
+static void
+coalesce_expire(coalesce_t *coalesce, gint64 tick)
+{
+  coalesce_entry_t *entry;
+  GQueue *slot;
+  GList *link, *next;
+
+  slot = &coalesce->wheel[tick % COALESCE_WHEEL_SIZE];
+
+  for (link = slot->head; link; link = next)
+    {
+      next = link->next;
+      entry = (coalesce_entry_t *) link->data;
+
+      /* the slot also holds the entries due on a later turn of the wheel */
+      if (entry->tick > tick)
+        continue;
+
+      g_queue_unlink(slot, link);
+      g_hash_table_remove(coalesce->entries, entry->file);
+
+      if (coalesce->watcher->queue)
+        queue_push(coalesce->watcher->queue, entry->file, entry->event_type);
+      else
+        watcher_event_dispatch(coalesce->watcher, entry->file,
+            entry->event_type);
+
+      g_free(entry->file);
+      g_free(entry);
+    }
+}
+
+static gboolean
+coalesce_timeout(gpointer user_data)
+{
+  coalesce_t *coalesce;
+  gint64 now;
+
+  coalesce = (coalesce_t *) user_data;
+
+  statcache_begin();
+
+  now = coalesce_get_tick(coalesce);
+
+  /* a single turn visits every slot if the main loop was stalled */
+  if (now - coalesce->cursor > COALESCE_WHEEL_SIZE)
+    coalesce->cursor = now - COALESCE_WHEEL_SIZE;
+
+  while (coalesce->cursor < now)
+    {
+      coalesce->cursor++;
+
+      coalesce_expire(coalesce, coalesce->cursor);
+    }
+
+  if (g_hash_table_size(coalesce->entries) > 0)
+    return TRUE;
+
+  coalesce->source = 0;
+
+  return FALSE;
+}
+
+coalesce_t *
+coalesce_new(watcher_t *watcher, guint delay)
+{
+  coalesce_t *coalesce;
+  gint i;
+
+  coalesce = g_new0(coalesce_t, 1);
+  coalesce->watcher = watcher;
+  coalesce->delay = delay;
+  coalesce->tick = MAX(delay / COALESCE_WHEEL_TICKS, 1);
+  coalesce->entries = g_hash_table_new(g_str_hash, g_str_equal);
+
+  for (i = 0; i < COALESCE_WHEEL_SIZE; i++)
+    g_queue_init(&coalesce->wheel[i]);
+
+  return coalesce;
+}
+
+void
+coalesce_free(coalesce_t *coalesce)
+{
+  if (!coalesce)
+    return;
+
+  coalesce_flush(coalesce);
+
+  g_hash_table_destroy(coalesce->entries);
+  g_free(coalesce);
+}
+
+void
+coalesce_add(coalesce_t *coalesce, const gchar *file,
+    GFileMonitorEvent event_type)
+{
+  coalesce_entry_t *entry;
+  gboolean cancel;
+
+  entry = g_hash_table_lookup(coalesce->entries, file);
+  if (!entry)
+    {
+      entry = g_new0(coalesce_entry_t, 1);
+      entry->file = g_strdup(file);
+      entry->event_type = event_type;
+      entry->link.data = entry;
+
+      g_hash_table_insert(coalesce->entries, entry->file, entry);
+
+      coalesce_schedule(coalesce, entry);
+
+      return;
+    }
+
+  g_queue_unlink(&coalesce->wheel[entry->tick % COALESCE_WHEEL_SIZE],
+      &entry->link);
+
+  entry->event_type = coalesce_merge(entry->event_type, event_type, &cancel);
+
+  LOG_DEBUG("%s: %s (event_type=%d, file=%s)",
+      coalesce->watcher->name, N_("event coalesced"), entry->event_type, file);
+
+  if (cancel)
+    {
+      g_hash_table_remove(coalesce->entries, entry->file);
+
+      g_free(entry->file);
+      g_free(entry);
+
+      return;
+    }
+
+  coalesce_schedule(coalesce, entry);
+}
+
+void
+coalesce_flush(coalesce_t *coalesce)
+{
+  gint i;
+
+  if (coalesce->source)
+    {
+      g_source_remove(coalesce->source);
+      coalesce->source = 0;
+    }
+
+  statcache_begin();
+
+  /* expire every entry, the nearest deadlines first */
+  coalesce->cursor = MAX(coalesce->cursor, coalesce_get_tick(coalesce));
+
+  for (i = 1; i <= COALESCE_WHEEL_SIZE; i++)
+    coalesce_expire(coalesce, coalesce->cursor + i + COALESCE_WHEEL_SIZE);
+}
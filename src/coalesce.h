@@ -0,0 +1,59 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef COALESCE_H_
+#define COALESCE_H_
+
+#include "common.h"
+
+struct _watcher_t;
+
+typedef struct _coalesce_entry_t
+{
+  gchar *file;
+  GFileMonitorEvent event_type;
+  gint64 tick;
+  GList link;
+} coalesce_entry_t;
+
+typedef struct _coalesce_t
+{
+  struct _watcher_t *watcher;
+  guint delay;
+  guint tick;
+#define COALESCE_WHEEL_SIZE             64
+#define COALESCE_WHEEL_TICKS            16
+  GQueue wheel[COALESCE_WHEEL_SIZE];
+  gint64 cursor;
+  GHashTable *entries;
+  guint source;
+} coalesce_t;
+
+coalesce_t *
+coalesce_new(struct _watcher_t *watcher, guint delay);
+void
+coalesce_free(coalesce_t *coalesce);
+void
+coalesce_add(coalesce_t *coalesce, const gchar *file,
+    GFileMonitorEvent event_type);
+void
+coalesce_flush(coalesce_t *coalesce);
+
+#endif /* COALESCE_H_ */
@@ -0,0 +1,221 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "fmon.h"
+#include "command.h"
+#include "watcher.h"
+
+#include <string.h>
+
+/*
+ * The Exec string is split once into arguments with the shell quoting rules,
+ * then each argument into literal and placeholder segments. Expanding a
+ * command for an event only copies the segments, and a substituted value
+ * always stays inside its argument whatever the characters it holds.
+ */
+
+static const struct
+{
+  const gchar *name;
+  guint key;
+} command_keys[] =
+  {
+    { CONFIG_KEY_WATCHER_EXEC_KEY_NAME, COMMAND_KEY_NAME },
+    { CONFIG_KEY_WATCHER_EXEC_KEY_PATH, COMMAND_KEY_PATH },
+    { CONFIG_KEY_WATCHER_EXEC_KEY_EVENT, COMMAND_KEY_EVENT },
+    { CONFIG_KEY_WATCHER_EXEC_KEY_FILE, COMMAND_KEY_FILE },
+    { CONFIG_KEY_WATCHER_EXEC_KEY_RFILE, COMMAND_KEY_RFILE } };
+
+static void
+command_parse_arg(command_arg_t *arg, const gchar *value)
+{
+  GArray *segments;
+  command_segment_t segment;
+  const gchar *start, *ptr;
+  gsize len;
+  guint i;
+
+  segments = g_array_new(FALSE, FALSE, sizeof(command_segment_t));
+
+  for (start = ptr = value; *ptr; ptr++)
+    {
+      if (*ptr != '$')
+        continue;
+
+      for (i = 0; i < G_N_ELEMENTS(command_keys); i++)
+        {
+          len = strlen(command_keys[i].name);
+          if (strncmp(ptr, command_keys[i].name, len) == 0)
+            break;
+        }
+
+      if (i == G_N_ELEMENTS(command_keys))
+        continue;
+
+      if (ptr > start)
+        {
+          segment.key = COMMAND_KEY_LITERAL;
+          segment.text = g_strndup(start, ptr - start);
+          segment.len = ptr - start;
+          g_array_append_val(segments, segment);
+        }
+
+      segment.key = command_keys[i].key;
+      segment.text = NULL;
+      segment.len = 0;
+      g_array_append_val(segments, segment);
+
+      ptr += len - 1;
+      start = ptr + 1;
+    }
+
+  if (ptr > start)
+    {
+      segment.key = COMMAND_KEY_LITERAL;
+      segment.text = g_strndup(start, ptr - start);
+      segment.len = ptr - start;
+      g_array_append_val(segments, segment);
+    }
+
+  arg->n_segments = segments->len;
+  arg->segments = (command_segment_t *) g_array_free(segments, FALSE);
+}
+
+command_t *
+command_new(const gchar *exec, GError **error)
+{
+  command_t *command;
+  gchar **argv;
+  gint argc, i;
+
+  if (!g_shell_parse_argv(exec, &argc, &argv, error))
+    return NULL;
+
+  command = g_new0(command_t, 1);
+  command->n_args = argc;
+  command->args = g_new0(command_arg_t, argc);
+
+  for (i = 0; i < argc; i++)
+    command_parse_arg(&command->args[i], argv[i]);
+
+  g_strfreev(argv);
+
+  return command;
+}
+
+void
+command_free(command_t *command)
+{
+  guint i, j;
+
+  if (!command)
+    return;
+
+  for (i = 0; i < command->n_args; i++)
+    {
+      for (j = 0; j < command->args[i].n_segments; j++)
+        g_free(command->args[i].segments[j].text);
+
+      g_free(command->args[i].segments);
+    }
+
+  g_free(command->args);
+  g_free(command);
+}
+
+static const gchar *
+command_get_value(guint key, const watcher_t *watcher,
+    const watcher_event_t *event)
+{
+  switch (key)
+  {
+  case COMMAND_KEY_NAME:
+    return watcher->name;
+
+  case COMMAND_KEY_PATH:
+    return watcher->path;
+
+  case COMMAND_KEY_EVENT:
+    return event ? event->event : "";
+
+  case COMMAND_KEY_FILE:
+    return event ? event->file : "";
+
+  case COMMAND_KEY_RFILE:
+    return event ? event->rfile : "";
+
+  default:
+    return "";
+  }
+}
+
+gchar **
+command_expand(const command_t *command, const watcher_t *watcher,
+    const watcher_event_t *event)
+{
+  const command_segment_t *segment;
+  const gchar *values[G_N_ELEMENTS(command_keys) + 1];
+  gsize lengths[G_N_ELEMENTS(command_keys) + 1];
+  gchar **argv, *ptr;
+  gsize len;
+  guint i, j;
+
+  for (i = 1; i <= G_N_ELEMENTS(command_keys); i++)
+    {
+      values[i] = command_get_value(i, watcher, event);
+      lengths[i] = strlen(values[i]);
+    }
+
+  argv = g_new(gchar *, command->n_args + 1);
+
+  for (i = 0; i < command->n_args; i++)
+    {
+      len = 0;
+      for (j = 0; j < command->args[i].n_segments; j++)
+        {
+          segment = &command->args[i].segments[j];
+          len += segment->key ? lengths[segment->key] : segment->len;
+        }
+
+      argv[i] = ptr = g_malloc(len + 1);
+
+      for (j = 0; j < command->args[i].n_segments; j++)
+        {
+          segment = &command->args[i].segments[j];
+
+          if (segment->key)
+            {
+              memcpy(ptr, values[segment->key], lengths[segment->key]);
+              ptr += lengths[segment->key];
+            }
+          else
+            {
+              memcpy(ptr, segment->text, segment->len);
+              ptr += segment->len;
+            }
+        }
+
+      *ptr = '\0';
+    }
+
+  argv[command->n_args] = NULL;
+
+  return argv;
+}
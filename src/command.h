@@ -0,0 +1,62 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef COMMAND_H_
+#define COMMAND_H_
+
+#include "common.h"
+
+struct _watcher_t;
+struct _watcher_event_t;
+
+typedef struct _command_segment_t
+{
+  guint key;
+#define COMMAND_KEY_LITERAL             0
+#define COMMAND_KEY_NAME                1
+#define COMMAND_KEY_PATH                2
+#define COMMAND_KEY_EVENT               3
+#define COMMAND_KEY_FILE                4
+#define COMMAND_KEY_RFILE               5
+  gchar *text;
+  gsize len;
+} command_segment_t;
+
+typedef struct _command_arg_t
+{
+  command_segment_t *segments;
+  guint n_segments;
+} command_arg_t;
+
+typedef struct _command_t
+{
+  command_arg_t *args;
+  guint n_args;
+} command_t;
+
+command_t *
+command_new(const gchar *exec, GError **error);
+void
+command_free(command_t *command);
+gchar **
+command_expand(const command_t *command, const struct _watcher_t *watcher,
+    const struct _watcher_event_t *event);
+
+#endif /* COMMAND_H_ */
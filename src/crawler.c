@@ -0,0 +1,801 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "fmon.h"
+#include "crawler.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef OS_LINUX
+#include <sys/syscall.h>
+#endif
+
+#define CRAWLER_THREADS_MAX     16
+#define CRAWLER_SPAWN_THRESHOLD 8
+#define CRAWLER_BUFFER          32768
+
+typedef struct _crawler_task_t
+{
+  gchar *path;
+  guint depth;
+} crawler_task_t;
+
+typedef struct _crawler_worker_t
+{
+  struct _crawler_t *crawler;
+  GMutex lock;
+  GQueue tasks;
+  GThread *thread;
+} crawler_worker_t;
+
+typedef struct _crawler_t
+{
+  crawler_worker_t *workers;
+  gint n_workers;
+  gint n_started;
+  gint maxdepth;
+  gboolean mount;
+  dev_t dev;
+  crawler_prune_t prune;
+  crawler_func_t func;
+  crawler_func_t entry;
+  gpointer user_data;
+  GMutex lock;
+  GCond cond;
+  gint queued;
+  gint pending;
+  gint idle;
+  gboolean failed;
+} crawler_t;
+
+#ifdef OS_LINUX
+struct linux_dirent64
+{
+  guint64 d_ino;
+  gint64 d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+#endif
+
+static gpointer
+crawler_worker_run(gpointer user_data);
+
+static void
+crawler_push(crawler_worker_t *worker, gchar *path, guint depth)
+{
+  crawler_t *crawler;
+  crawler_task_t *task;
+
+  crawler = worker->crawler;
+
+  task = g_new(crawler_task_t, 1);
+  task->path = path;
+  task->depth = depth;
+
+  g_atomic_int_inc(&crawler->pending);
+
+  g_mutex_lock(&worker->lock);
+  g_queue_push_tail(&worker->tasks, task);
+  g_mutex_unlock(&worker->lock);
+
+  g_atomic_int_inc(&crawler->queued);
+
+  if ((g_atomic_int_get(&crawler->idle) > 0)
+      || ((g_atomic_int_get(&crawler->queued) > CRAWLER_SPAWN_THRESHOLD)
+          && (g_atomic_int_get(&crawler->n_started) < crawler->n_workers)))
+    {
+      g_mutex_lock(&crawler->lock);
+
+      /* helper threads are only started once the tree proves wide enough */
+      if ((g_atomic_int_get(&crawler->queued) > CRAWLER_SPAWN_THRESHOLD)
+          && (crawler->n_started < crawler->n_workers))
+        {
+          crawler_worker_t *helper;
+
+          helper = &crawler->workers[crawler->n_started];
+          g_atomic_int_inc(&crawler->n_started);
+
+          helper->thread = g_thread_new(PACKAGE "-crawler", crawler_worker_run,
+              helper);
+        }
+
+      g_cond_signal(&crawler->cond);
+      g_mutex_unlock(&crawler->lock);
+    }
+}
+
+static crawler_task_t *
+crawler_pop(crawler_worker_t *worker)
+{
+  crawler_t *crawler;
+  crawler_worker_t *victim;
+  crawler_task_t *task;
+  gint i, n;
+
+  crawler = worker->crawler;
+
+  g_mutex_lock(&worker->lock);
+  task = g_queue_pop_tail(&worker->tasks);
+  g_mutex_unlock(&worker->lock);
+
+  /* steal the oldest, usually shallowest, task of another worker */
+  n = crawler->n_workers;
+  for (i = 1; !task && (i < n); i++)
+    {
+      victim = &crawler->workers[((worker - crawler->workers) + i) % n];
+
+      g_mutex_lock(&victim->lock);
+      task = g_queue_pop_head(&victim->tasks);
+      g_mutex_unlock(&victim->lock);
+    }
+
+  if (task)
+    g_atomic_int_add(&crawler->queued, -1);
+
+  return task;
+}
+
+static gboolean
+crawler_is_directory(gint fd, const gchar *name, guchar type)
+{
+  struct stat st;
+
+  if (type == DT_DIR)
+    return TRUE;
+
+  if (type != DT_UNKNOWN)
+    return FALSE;
+
+  if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+    return FALSE;
+
+  return S_ISDIR(st.st_mode);
+}
+
+static void
+crawler_add_child(crawler_worker_t *worker, crawler_task_t *task, gint fd,
+    const gchar *name, guchar type, gboolean descend)
+{
+  crawler_t *crawler;
+  gboolean directory;
+  gchar *path;
+
+  if ((name[0] == '.')
+      && ((name[1] == '\0') || ((name[1] == '.') && (name[2] == '\0'))))
+    return;
+
+  crawler = worker->crawler;
+
+  directory = descend && crawler_is_directory(fd, name, type);
+  if (!directory && !crawler->entry)
+    return;
+
+  path = g_build_path(G_DIR_SEPARATOR_S, task->path, name, NULL);
+
+  /* pruned subtrees are neither registered nor read */
+  if (directory
+      && !(crawler->prune && crawler->prune(path, crawler->user_data)))
+    {
+      crawler_push(worker, path, task->depth + 1);
+
+      return;
+    }
+
+  /* the other entries are only reported */
+  if (crawler->entry)
+    {
+      g_mutex_lock(&crawler->lock);
+      crawler->entry(path, task->depth + 1, crawler->user_data);
+      g_mutex_unlock(&crawler->lock);
+    }
+
+  g_free(path);
+}
+
+static void
+crawler_read_children(crawler_worker_t *worker, crawler_task_t *task, gint fd,
+    gboolean descend)
+{
+#ifdef OS_LINUX
+  struct linux_dirent64 *entry;
+  gchar buffer[CRAWLER_BUFFER]
+      __attribute__ ((aligned(__alignof__(struct linux_dirent64))));
+  glong len, offset;
+
+  while ((len = syscall(SYS_getdents64, fd, buffer, sizeof(buffer))) > 0)
+    {
+      for (offset = 0; offset < len; offset += entry->d_reclen)
+        {
+          entry = (struct linux_dirent64 *) (buffer + offset);
+
+          crawler_add_child(worker, task, fd, entry->d_name, entry->d_type,
+              descend);
+        }
+    }
+
+  if (len < 0)
+    {
+      LOG_DEBUG("%s (path=%s, %s)",
+          N_("failed to read directory entries"), task->path, g_strerror(errno));
+    }
+
+  close(fd);
+#else
+  struct dirent *entry;
+  DIR *dir;
+
+  dir = fdopendir(fd);
+  if (!dir)
+    {
+      close(fd);
+
+      return;
+    }
+
+  while ((entry = readdir(dir)) != NULL)
+    {
+      crawler_add_child(worker, task, fd, entry->d_name, entry->d_type,
+          descend);
+    }
+
+  closedir(dir);
+#endif
+}
+
+static void
+crawler_process(crawler_worker_t *worker, crawler_task_t *task)
+{
+  crawler_t *crawler;
+  struct stat st;
+  gboolean ret, descend;
+  gint fd;
+
+  crawler = worker->crawler;
+
+  /* children are reached through their DT_DIR entry, never through a link */
+  fd = open(task->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+  if (fd < 0)
+    {
+      LOG_DEBUG("%s (path=%s, %s)",
+          N_("failed to open directory"), task->path, g_strerror(errno));
+
+      return;
+    }
+
+  if (crawler->mount)
+    {
+      if ((fstat(fd, &st) != 0) || (st.st_dev != crawler->dev))
+        {
+          LOG_DEBUG("%s (path=%s)",
+              N_("directory on another filesystem skipped"), task->path);
+
+          close(fd);
+
+          return;
+        }
+    }
+
+  g_mutex_lock(&crawler->lock);
+  ret = !crawler->failed && crawler->func(task->path, task->depth,
+      crawler->user_data);
+  if (!ret)
+    crawler->failed = TRUE;
+  g_mutex_unlock(&crawler->lock);
+
+  if (!ret)
+    {
+      close(fd);
+
+      return;
+    }
+
+  /* the entries of the deepest directories are still reported */
+  descend = (crawler->maxdepth <= 0) || (task->depth < crawler->maxdepth);
+  if (!descend && !crawler->entry)
+    {
+      close(fd);
+
+      return;
+    }
+
+  crawler_read_children(worker, task, fd, descend);
+}
+
+static gpointer
+crawler_worker_run(gpointer user_data)
+{
+  crawler_worker_t *worker;
+  crawler_t *crawler;
+  crawler_task_t *task;
+
+  worker = (crawler_worker_t *) user_data;
+  crawler = worker->crawler;
+
+  for (;;)
+    {
+      task = crawler_pop(worker);
+      if (!task)
+        {
+          g_mutex_lock(&crawler->lock);
+
+          g_atomic_int_inc(&crawler->idle);
+          while ((g_atomic_int_get(&crawler->queued) == 0)
+              && (g_atomic_int_get(&crawler->pending) > 0))
+            g_cond_wait(&crawler->cond, &crawler->lock);
+          g_atomic_int_add(&crawler->idle, -1);
+
+          g_mutex_unlock(&crawler->lock);
+
+          if (g_atomic_int_get(&crawler->pending) == 0)
+            break;
+
+          continue;
+        }
+
+      crawler_process(worker, task);
+
+      g_free(task->path);
+      g_free(task);
+
+      if (g_atomic_int_dec_and_test(&crawler->pending))
+        {
+          g_mutex_lock(&crawler->lock);
+          g_cond_broadcast(&crawler->cond);
+          g_mutex_unlock(&crawler->lock);
+        }
+    }
+
+  return NULL;
+}
+
+gboolean
+crawler_run(const gchar *path, guint depth, gint maxdepth, gboolean mount,
+    guint threads, crawler_prune_t prune, crawler_func_t func,
+    crawler_func_t entry, gpointer user_data)
+{
+  crawler_t crawler;
+  crawler_task_t task;
+  struct stat st;
+  gboolean ret;
+  gint fd;
+  guint i;
+
+  if (stat(path, &st) != 0)
+    {
+      LOG_ERROR("%s (path=%s, %s)",
+          N_("failed to stat directory"), path, g_strerror(errno));
+
+      return FALSE;
+    }
+
+  if (threads == 0)
+    threads = g_get_num_processors();
+  threads = CLAMP(threads, 1, CRAWLER_THREADS_MAX);
+
+  memset(&crawler, 0, sizeof(crawler));
+  crawler.n_workers = threads;
+  crawler.n_started = 1;
+  crawler.maxdepth = maxdepth;
+  crawler.mount = mount;
+  crawler.dev = st.st_dev;
+  crawler.prune = prune;
+  crawler.func = func;
+  crawler.entry = entry;
+  crawler.user_data = user_data;
+  g_mutex_init(&crawler.lock);
+  g_cond_init(&crawler.cond);
+
+  crawler.workers = g_new0(crawler_worker_t, threads);
+  for (i = 0; i < threads; i++)
+    {
+      crawler.workers[i].crawler = &crawler;
+      g_mutex_init(&crawler.workers[i].lock);
+      g_queue_init(&crawler.workers[i].tasks);
+    }
+
+  /* the calling thread is the first worker, the root may be a symbolic link */
+  task.path = (gchar *) path;
+  task.depth = depth;
+
+  fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+    {
+      LOG_ERROR("%s (path=%s, %s)",
+          N_("failed to open directory"), path, g_strerror(errno));
+
+      crawler.failed = TRUE;
+    }
+  else if (!func(path, depth, user_data))
+    {
+      crawler.failed = TRUE;
+
+      close(fd);
+    }
+  else if ((maxdepth > 0) && (depth >= maxdepth) && !entry)
+    {
+      close(fd);
+    }
+  else
+    {
+      g_atomic_int_inc(&crawler.pending);
+
+      crawler_read_children(&crawler.workers[0], &task, fd,
+          (maxdepth <= 0) || (depth < maxdepth));
+
+      if (g_atomic_int_dec_and_test(&crawler.pending))
+        {
+          g_mutex_lock(&crawler.lock);
+          g_cond_broadcast(&crawler.cond);
+          g_mutex_unlock(&crawler.lock);
+        }
+
+      crawler_worker_run(&crawler.workers[0]);
+    }
+
+  for (i = 1; i < (guint) crawler.n_started; i++)
+    g_thread_join(crawler.workers[i].thread);
+
+  for (i = 0; i < threads; i++)
+    g_mutex_clear(&crawler.workers[i].lock);
+
+  g_free(crawler.workers);
+  g_cond_clear(&crawler.cond);
+  g_mutex_clear(&crawler.lock);
+
+  ret = !crawler.failed;
+
+  return ret;
+}
+
+/*
+ * A job crawls a tree from the main loop, breadth first, a bounded number of
+ * directories at a time. Its callbacks run in the calling thread, so they need
+ * no locking: each step registers its directories first, then reads them with
+ * up to the given number of threads, and queues their children in order.
+ */
+
+typedef struct _crawler_child_t
+{
+  gboolean directory;
+  gchar name[];
+} crawler_child_t;
+
+typedef struct _crawler_slot_t
+{
+  crawler_task_t *task;
+  gint fd;
+  gboolean descend;
+  GPtrArray *children;
+} crawler_slot_t;
+
+typedef struct _crawler_reader_t
+{
+  crawler_slot_t *slots;
+  guint n_slots;
+  guint first;
+  guint stride;
+  gboolean entries;
+  GThread *thread;
+} crawler_reader_t;
+
+static void
+crawler_job_push(crawler_job_t *job, gchar *path, guint depth)
+{
+  crawler_task_t *task;
+
+  task = g_new(crawler_task_t, 1);
+  task->path = path;
+  task->depth = depth;
+
+  g_queue_push_tail(&job->tasks, task);
+}
+
+static void
+crawler_slot_add(crawler_slot_t *slot, gint fd, const gchar *name,
+    guchar type, gboolean entries)
+{
+  crawler_child_t *child;
+  gboolean directory;
+  gsize len;
+
+  if ((name[0] == '.')
+      && ((name[1] == '\0') || ((name[1] == '.') && (name[2] == '\0'))))
+    return;
+
+  directory = slot->descend && crawler_is_directory(fd, name, type);
+  if (!directory && !entries)
+    return;
+
+  len = strlen(name);
+
+  child = (crawler_child_t *) g_malloc(sizeof(crawler_child_t) + len + 1);
+  child->directory = directory;
+  memcpy(child->name, name, len + 1);
+
+  g_ptr_array_add(slot->children, child);
+}
+
+static void
+crawler_slot_read(crawler_slot_t *slot, gboolean entries)
+{
+#ifdef OS_LINUX
+  struct linux_dirent64 *entry;
+  gchar buffer[CRAWLER_BUFFER]
+      __attribute__ ((aligned(__alignof__(struct linux_dirent64))));
+  glong len, offset;
+
+  while ((len = syscall(SYS_getdents64, slot->fd, buffer, sizeof(buffer))) > 0)
+    {
+      for (offset = 0; offset < len; offset += entry->d_reclen)
+        {
+          entry = (struct linux_dirent64 *) (buffer + offset);
+
+          crawler_slot_add(slot, slot->fd, entry->d_name, entry->d_type,
+              entries);
+        }
+    }
+
+  close(slot->fd);
+#else
+  struct dirent *entry;
+  DIR *dir;
+
+  dir = fdopendir(slot->fd);
+  if (!dir)
+    {
+      close(slot->fd);
+
+      return;
+    }
+
+  while ((entry = readdir(dir)) != NULL)
+    crawler_slot_add(slot, dirfd(dir), entry->d_name, entry->d_type, entries);
+
+  closedir(dir);
+#endif
+}
+
+static gpointer
+crawler_reader_run(gpointer user_data)
+{
+  crawler_reader_t *reader;
+  guint i;
+
+  reader = (crawler_reader_t *) user_data;
+
+  for (i = reader->first; i < reader->n_slots; i += reader->stride)
+    {
+      if (reader->slots[i].fd >= 0)
+        crawler_slot_read(&reader->slots[i], reader->entries);
+    }
+
+  return NULL;
+}
+
+static gboolean
+crawler_job_open(crawler_job_t *job, crawler_slot_t *slot)
+{
+  crawler_task_t *task;
+  struct stat st;
+  gint fd, flags;
+
+  task = slot->task;
+
+  /* as in a crawl, only the root may be a symbolic link */
+  flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+  if (job->started)
+    flags |= O_NOFOLLOW;
+  job->started = TRUE;
+
+  fd = open(task->path, flags);
+  if (fd < 0)
+    {
+      LOG_DEBUG("%s (path=%s, %s)",
+          N_("failed to open directory"), task->path, g_strerror(errno));
+
+      return FALSE;
+    }
+
+  if (job->mount && ((fstat(fd, &st) != 0) || (st.st_dev != job->dev)))
+    {
+      LOG_DEBUG("%s (path=%s)",
+          N_("directory on another filesystem skipped"), task->path);
+
+      close(fd);
+
+      return FALSE;
+    }
+
+  job->directories++;
+
+  /* the directory is registered before being read */
+  if (!job->func(task->path, task->depth, job->user_data))
+    {
+      job->failed = TRUE;
+
+      close(fd);
+
+      return FALSE;
+    }
+
+  slot->descend = (job->maxdepth <= 0) || (task->depth < job->maxdepth);
+  if (!slot->descend && !job->entry)
+    {
+      close(fd);
+
+      return FALSE;
+    }
+
+  slot->fd = fd;
+
+  return TRUE;
+}
+
+static void
+crawler_job_merge(crawler_job_t *job, crawler_slot_t *slot)
+{
+  crawler_child_t *child;
+  gchar *path;
+  guint i;
+
+  for (i = 0; i < slot->children->len; i++)
+    {
+      child = (crawler_child_t *) g_ptr_array_index(slot->children, i);
+
+      path = g_build_path(G_DIR_SEPARATOR_S, slot->task->path, child->name,
+          NULL);
+
+      if (child->directory && !job->failed
+          && !(job->prune && job->prune(path, job->user_data)))
+        {
+          crawler_job_push(job, path, slot->task->depth + 1);
+
+          continue;
+        }
+
+      if (job->entry && !job->failed)
+        job->entry(path, slot->task->depth + 1, job->user_data);
+
+      g_free(path);
+    }
+}
+
+crawler_job_t *
+crawler_job_new(const gchar *path, guint depth, gint maxdepth, gboolean mount,
+    guint threads, crawler_prune_t prune, crawler_func_t func,
+    crawler_func_t entry, gpointer user_data)
+{
+  crawler_job_t *job;
+  struct stat st;
+
+  if (stat(path, &st) != 0)
+    {
+      LOG_ERROR("%s (path=%s, %s)",
+          N_("failed to stat directory"), path, g_strerror(errno));
+
+      return NULL;
+    }
+
+  if (threads == 0)
+    threads = g_get_num_processors();
+
+  job = g_new0(crawler_job_t, 1);
+  g_queue_init(&job->tasks);
+  job->maxdepth = maxdepth;
+  job->mount = mount;
+  job->dev = st.st_dev;
+  job->threads = CLAMP(threads, 1, CRAWLER_THREADS_MAX);
+  job->prune = prune;
+  job->func = func;
+  job->entry = entry;
+  job->user_data = user_data;
+
+  crawler_job_push(job, g_strdup(path), depth);
+
+  return job;
+}
+
+void
+crawler_job_free(crawler_job_t *job)
+{
+  crawler_task_t *task;
+
+  if (!job)
+    return;
+
+  while ((task = g_queue_pop_head(&job->tasks)) != NULL)
+    {
+      g_free(task->path);
+      g_free(task);
+    }
+
+  g_free(job);
+}
+
+gboolean
+crawler_job_step(crawler_job_t *job, guint budget)
+{
+  crawler_slot_t *slots;
+  crawler_reader_t *readers;
+  crawler_task_t *task;
+  guint i, n = 0, n_open = 0, n_readers;
+
+  slots = g_new0(crawler_slot_t, MIN(budget, job->tasks.length));
+
+  while (!job->failed && (n < budget)
+      && ((task = g_queue_pop_head(&job->tasks)) != NULL))
+    {
+      slots[n].task = task;
+      slots[n].fd = -1;
+      slots[n].children = g_ptr_array_new_with_free_func(g_free);
+
+      if (crawler_job_open(job, &slots[n]))
+        n_open++;
+
+      n++;
+    }
+
+  /* the helper threads only pay off with several directories to read */
+  n_readers = MIN(job->threads, n_open);
+  if (n_readers < 1)
+    n_readers = 1;
+
+  readers = g_new0(crawler_reader_t, n_readers);
+  for (i = 0; i < n_readers; i++)
+    {
+      readers[i].slots = slots;
+      readers[i].n_slots = n;
+      readers[i].first = i;
+      readers[i].stride = n_readers;
+      readers[i].entries = (job->entry != NULL);
+
+      if (i > 0)
+        readers[i].thread = g_thread_new(PACKAGE "-crawler",
+            crawler_reader_run, &readers[i]);
+    }
+
+  crawler_reader_run(&readers[0]);
+
+  for (i = 1; i < n_readers; i++)
+    g_thread_join(readers[i].thread);
+
+  g_free(readers);
+
+  /* the children are queued in the order of their parents */
+  for (i = 0; i < n; i++)
+    {
+      crawler_job_merge(job, &slots[i]);
+
+      g_ptr_array_free(slots[i].children, TRUE);
+      g_free(slots[i].task->path);
+      g_free(slots[i].task);
+    }
+
+  g_free(slots);
+
+  return !job->failed && !g_queue_is_empty(&job->tasks);
+}
@@ -0,0 +1,63 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef CRAWLER_H_
+#define CRAWLER_H_
+
+#include "common.h"
+
+#include <sys/types.h>
+
+typedef gboolean
+(*crawler_prune_t)(const gchar *path, gpointer user_data);
+typedef gboolean
+(*crawler_func_t)(const gchar *path, guint depth, gpointer user_data);
+
+gboolean
+crawler_run(const gchar *path, guint depth, gint maxdepth, gboolean mount,
+    guint threads, crawler_prune_t prune, crawler_func_t func,
+    crawler_func_t entry, gpointer user_data);
+
+typedef struct _crawler_job_t
+{
+  GQueue tasks;
+  gint maxdepth;
+  gboolean mount;
+  dev_t dev;
+  guint threads;
+  crawler_prune_t prune;
+  crawler_func_t func;
+  crawler_func_t entry;
+  gpointer user_data;
+  gboolean started;
+  gboolean failed;
+  guint directories;
+} crawler_job_t;
+
+crawler_job_t *
+crawler_job_new(const gchar *path, guint depth, gint maxdepth, gboolean mount,
+    guint threads, crawler_prune_t prune, crawler_func_t func,
+    crawler_func_t entry, gpointer user_data);
+void
+crawler_job_free(crawler_job_t *job);
+gboolean
+crawler_job_step(crawler_job_t *job, guint budget);
+
+#endif /* CRAWLER_H_ */
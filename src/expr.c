@@ -0,0 +1,736 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "fmon.h"
+#include "expr.h"
+#include "pattern.h"
+#include "watcher.h"
+
+#include <string.h>
+#include <time.h>
+
+/*
+ * A filter expression is parsed by recursive descent into a sequence of
+ * instructions run on a single boolean register: the predicates set it, and
+ * the "and"/"or" operators are conditional jumps which skip the remaining
+ * operands once the result is known.
+ */
+
+typedef struct _expr_parser_t
+{
+  expr_t *expr;
+  const gchar *input;
+  const gchar *p;
+  guint token;
+#define EXPR_TOKEN_END                  0
+#define EXPR_TOKEN_WORD                 1
+#define EXPR_TOKEN_STRING               2
+#define EXPR_TOKEN_OPEN                 3
+#define EXPR_TOKEN_CLOSE                4
+#define EXPR_TOKEN_NOT                  5
+#define EXPR_TOKEN_AND                  6
+#define EXPR_TOKEN_OR                   7
+#define EXPR_TOKEN_CMP                  8
+  guint cmp;
+  const gchar *start;
+  gsize len;
+  GError **error;
+} expr_parser_t;
+
+typedef struct _expr_field_t
+{
+  const gchar *name;
+  guint op;
+  guint kind;
+#define EXPR_KIND_SIZE                  0
+#define EXPR_KIND_AGE                   1
+#define EXPR_KIND_INTEGER               2
+#define EXPR_KIND_MODE                  3
+#define EXPR_KIND_TYPE                  4
+#define EXPR_KIND_STRING                5
+#define EXPR_KIND_EVENT                 6
+  gboolean stat;
+} expr_field_t;
+
+static const expr_field_t expr_fields[] =
+{
+  { "size", EXPR_OP_SIZE, EXPR_KIND_SIZE, TRUE },
+  { "mtime", EXPR_OP_MTIME, EXPR_KIND_AGE, TRUE },
+  { "ctime", EXPR_OP_CTIME, EXPR_KIND_AGE, TRUE },
+  { "atime", EXPR_OP_ATIME, EXPR_KIND_AGE, TRUE },
+  { "inode", EXPR_OP_INODE, EXPR_KIND_INTEGER, TRUE },
+  { "nlink", EXPR_OP_NLINK, EXPR_KIND_INTEGER, TRUE },
+  { "uid", EXPR_OP_UID, EXPR_KIND_INTEGER, TRUE },
+  { "gid", EXPR_OP_GID, EXPR_KIND_INTEGER, TRUE },
+  { "mode", EXPR_OP_MODE, EXPR_KIND_MODE, TRUE },
+  { "type", EXPR_OP_TYPE, EXPR_KIND_TYPE, TRUE },
+  { "path", EXPR_OP_PATH, EXPR_KIND_STRING, FALSE },
+  { "name", EXPR_OP_NAME, EXPR_KIND_STRING, FALSE },
+  { "event", EXPR_OP_EVENT, EXPR_KIND_EVENT, FALSE },
+  { NULL, 0, 0, FALSE }
+};
+
+static gboolean
+expr_parse_or(expr_parser_t *parser);
+
+static gboolean
+expr_error(expr_parser_t *parser, const gchar *message)
+{
+  g_set_error(parser->error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+      "%s (offset %d)", message, (gint) (parser->start - parser->input));
+
+  return FALSE;
+}
+
+static gboolean
+expr_is_word_char(gchar c)
+{
+  return g_ascii_isalnum(c) || (strchr("_.-/*?", c) && (c != '\0'));
+}
+
+static gboolean
+expr_next(expr_parser_t *parser)
+{
+  const gchar *p;
+  gchar quote;
+
+  p = parser->p;
+  while (g_ascii_isspace(*p))
+    p++;
+
+  parser->start = p;
+  parser->len = 1;
+
+  switch (*p)
+  {
+  case '\0':
+    {
+      parser->token = EXPR_TOKEN_END;
+      parser->len = 0;
+
+      break;
+    }
+
+  case '(':
+    {
+      parser->token = EXPR_TOKEN_OPEN;
+
+      break;
+    }
+
+  case ')':
+    {
+      parser->token = EXPR_TOKEN_CLOSE;
+
+      break;
+    }
+
+  case '!':
+    {
+      parser->token = (p[1] == '=') ? EXPR_TOKEN_CMP : EXPR_TOKEN_NOT;
+      parser->cmp = EXPR_CMP_NE;
+      parser->len = (p[1] == '=') ? 2 : 1;
+
+      break;
+    }
+
+  case '&':
+    {
+      parser->token = (p[1] == '&') ? EXPR_TOKEN_AND : EXPR_TOKEN_CMP;
+      parser->cmp = EXPR_CMP_ALL;
+      parser->len = (p[1] == '&') ? 2 : 1;
+
+      break;
+    }
+
+  case '|':
+    {
+      if (p[1] != '|')
+        return expr_error(parser, N_("unexpected character"));
+
+      parser->token = EXPR_TOKEN_OR;
+      parser->len = 2;
+
+      break;
+    }
+
+  case '=':
+    {
+      parser->token = EXPR_TOKEN_CMP;
+      parser->cmp = (p[1] == '~') ? EXPR_CMP_MATCH : EXPR_CMP_EQ;
+      parser->len = ((p[1] == '=') || (p[1] == '~')) ? 2 : 1;
+
+      break;
+    }
+
+  case '~':
+    {
+      parser->token = EXPR_TOKEN_CMP;
+      parser->cmp = EXPR_CMP_MATCH;
+
+      break;
+    }
+
+  case '<':
+  case '>':
+    {
+      parser->token = EXPR_TOKEN_CMP;
+      if (*p == '<')
+        parser->cmp = (p[1] == '=') ? EXPR_CMP_LE : EXPR_CMP_LT;
+      else
+        parser->cmp = (p[1] == '=') ? EXPR_CMP_GE : EXPR_CMP_GT;
+      parser->len = (p[1] == '=') ? 2 : 1;
+
+      break;
+    }
+
+  case '"':
+  case '\'':
+    {
+      quote = *p;
+
+      parser->start = ++p;
+      while (*p && (*p != quote))
+        p++;
+
+      if (*p != quote)
+        return expr_error(parser, N_("unterminated string"));
+
+      parser->token = EXPR_TOKEN_STRING;
+      parser->len = p - parser->start;
+      parser->p = p + 1;
+
+      return TRUE;
+    }
+
+  default:
+    {
+      if (!expr_is_word_char(*p))
+        return expr_error(parser, N_("unexpected character"));
+
+      while (expr_is_word_char(*p))
+        p++;
+
+      parser->token = EXPR_TOKEN_WORD;
+      parser->len = p - parser->start;
+
+      if ((parser->len == 3) && (strncmp(parser->start, "and", 3) == 0))
+        parser->token = EXPR_TOKEN_AND;
+      else if ((parser->len == 2) && (strncmp(parser->start, "or", 2) == 0))
+        parser->token = EXPR_TOKEN_OR;
+      else if ((parser->len == 3) && (strncmp(parser->start, "not", 3) == 0))
+        parser->token = EXPR_TOKEN_NOT;
+
+      break;
+    }
+  }
+
+  parser->p = parser->start + parser->len;
+
+  return TRUE;
+}
+
+static expr_insn_t *
+expr_emit(expr_t *expr, guint op)
+{
+  expr_insn_t *insn;
+
+  if (expr->n_code == expr->size)
+    {
+      expr->size = expr->size ? expr->size * 2 : 8;
+      expr->code = g_renew(expr_insn_t, expr->code, expr->size);
+    }
+
+  insn = &expr->code[expr->n_code++];
+  memset(insn, 0, sizeof(expr_insn_t));
+  insn->op = op;
+
+  return insn;
+}
+
+static gboolean
+expr_parse_number(expr_parser_t *parser, const gchar *text, guint kind,
+    gint64 *value)
+{
+  guint64 number, unit = 1;
+  gchar *end;
+
+  if (!g_ascii_isdigit(*text))
+    return expr_error(parser, N_("number expected"));
+
+  number = g_ascii_strtoull(text, &end, (kind == EXPR_KIND_MODE) ? 8 : 10);
+
+  if (kind == EXPR_KIND_SIZE)
+    {
+      if (g_strcmp0(end, "k") == 0 || g_strcmp0(end, "K") == 0)
+        unit = G_GUINT64_CONSTANT(1) << 10;
+      else if (g_strcmp0(end, "M") == 0)
+        unit = G_GUINT64_CONSTANT(1) << 20;
+      else if (g_strcmp0(end, "G") == 0)
+        unit = G_GUINT64_CONSTANT(1) << 30;
+      else if (g_strcmp0(end, "T") == 0)
+        unit = G_GUINT64_CONSTANT(1) << 40;
+      else if ((*end != '\0') && (g_strcmp0(end, "b") != 0))
+        return expr_error(parser, N_("invalid size unit"));
+    }
+  else if (kind == EXPR_KIND_AGE)
+    {
+      if (g_strcmp0(end, "m") == 0)
+        unit = 60;
+      else if (g_strcmp0(end, "h") == 0)
+        unit = 3600;
+      else if (g_strcmp0(end, "d") == 0)
+        unit = 86400;
+      else if (g_strcmp0(end, "w") == 0)
+        unit = 604800;
+      else if ((*end != '\0') && (g_strcmp0(end, "s") != 0))
+        return expr_error(parser, N_("invalid time unit"));
+    }
+  else if (*end != '\0')
+    return expr_error(parser, N_("invalid number"));
+
+  if ((number > G_MAXINT64 / unit)
+      || ((kind == EXPR_KIND_MODE) && (number > 07777)))
+    return expr_error(parser, N_("number out of range"));
+
+  *value = (gint64) (number * unit);
+
+  return TRUE;
+}
+
+static gboolean
+expr_parse_literal(expr_parser_t *parser, const expr_field_t *field,
+    expr_insn_t *insn, const gchar *text)
+{
+  switch (field->kind)
+  {
+  case EXPR_KIND_TYPE:
+    {
+      if (g_strcmp0(text, CONFIG_KEY_WATCHER_TYPE_BLOCK) == 0)
+        insn->value = S_IFBLK;
+      else if (g_strcmp0(text, CONFIG_KEY_WATCHER_TYPE_CHARACTER) == 0)
+        insn->value = S_IFCHR;
+      else if (g_strcmp0(text, CONFIG_KEY_WATCHER_TYPE_DIRECTORY) == 0)
+        insn->value = S_IFDIR;
+      else if (g_strcmp0(text, CONFIG_KEY_WATCHER_TYPE_FIFO) == 0)
+        insn->value = S_IFIFO;
+      else if (g_strcmp0(text, CONFIG_KEY_WATCHER_TYPE_REGULAR) == 0)
+        insn->value = S_IFREG;
+      else if (g_strcmp0(text, CONFIG_KEY_WATCHER_TYPE_SOCKET) == 0)
+        insn->value = S_IFSOCK;
+      else if (g_strcmp0(text, CONFIG_KEY_WATCHER_TYPE_SYMBOLICLINK) == 0)
+        insn->value = S_IFLNK;
+      else
+        return expr_error(parser, N_("invalid type"));
+
+      return TRUE;
+    }
+
+  case EXPR_KIND_EVENT:
+    {
+      if (g_strcmp0(text, CONFIG_KEY_WATCHER_EVENT_CHANGING) == 0)
+        insn->value = WATCHER_EVENT_CHANGING;
+      else if (g_strcmp0(text, CONFIG_KEY_WATCHER_EVENT_CHANGED) == 0)
+        insn->value = WATCHER_EVENT_CHANGED;
+      else if (g_strcmp0(text, CONFIG_KEY_WATCHER_EVENT_CREATED) == 0)
+        insn->value = WATCHER_EVENT_CREATED;
+      else if (g_strcmp0(text, CONFIG_KEY_WATCHER_EVENT_DELETED) == 0)
+        insn->value = WATCHER_EVENT_DELETED;
+      else if (g_strcmp0(text, CONFIG_KEY_WATCHER_EVENT_ATTRIBUTECHANGED) == 0)
+        insn->value = WATCHER_EVENT_ATTRIBUTECHANGED;
+      else if (g_strcmp0(text, CONFIG_KEY_WATCHER_EVENT_MOUNTED) == 0)
+        insn->value = WATCHER_EVENT_MOUNTED;
+      else if (g_strcmp0(text, CONFIG_KEY_WATCHER_EVENT_UNMOUNTED) == 0)
+        insn->value = WATCHER_EVENT_UNMOUNTED;
+      else
+        return expr_error(parser, N_("invalid event"));
+
+      return TRUE;
+    }
+
+  case EXPR_KIND_STRING:
+    {
+      if (insn->cmp == EXPR_CMP_MATCH)
+        {
+          gchar *patterns[] = { (gchar *) text, NULL };
+
+          insn->pattern = pattern_set_new(patterns);
+        }
+      else
+        insn->text = g_strdup(text);
+
+      return TRUE;
+    }
+
+  default:
+    return expr_parse_number(parser, text, field->kind, &insn->value);
+  }
+}
+
+static gboolean
+expr_parse_predicate(expr_parser_t *parser)
+{
+  const expr_field_t *field;
+  expr_insn_t *insn;
+  gchar *text;
+  gboolean valid;
+  guint cmp;
+
+  for (field = expr_fields; field->name; field++)
+    {
+      if ((strlen(field->name) == parser->len)
+          && (strncmp(field->name, parser->start, parser->len) == 0))
+        break;
+    }
+
+  if (!field->name)
+    return expr_error(parser, N_("unknown field"));
+
+  if (!expr_next(parser))
+    return FALSE;
+
+  if (parser->token != EXPR_TOKEN_CMP)
+    return expr_error(parser, N_("operator expected"));
+
+  cmp = parser->cmp;
+
+  switch (field->kind)
+  {
+  case EXPR_KIND_MODE:
+    valid = (cmp == EXPR_CMP_EQ) || (cmp == EXPR_CMP_NE)
+        || (cmp == EXPR_CMP_ALL);
+    break;
+
+  case EXPR_KIND_TYPE:
+  case EXPR_KIND_EVENT:
+    valid = (cmp == EXPR_CMP_EQ) || (cmp == EXPR_CMP_NE);
+    break;
+
+  case EXPR_KIND_STRING:
+    valid = (cmp == EXPR_CMP_EQ) || (cmp == EXPR_CMP_NE)
+        || (cmp == EXPR_CMP_MATCH);
+    break;
+
+  default:
+    valid = (cmp != EXPR_CMP_MATCH) && (cmp != EXPR_CMP_ALL);
+    break;
+  }
+
+  if (!valid)
+    return expr_error(parser, N_("invalid operator for the field"));
+
+  if (!expr_next(parser))
+    return FALSE;
+
+  if ((parser->token != EXPR_TOKEN_WORD)
+      && (parser->token != EXPR_TOKEN_STRING))
+    return expr_error(parser, N_("value expected"));
+
+  insn = expr_emit(parser->expr, field->op);
+  insn->cmp = cmp;
+
+  if (field->stat)
+    parser->expr->stat = TRUE;
+
+  text = g_strndup(parser->start, parser->len);
+  valid = expr_parse_literal(parser, field, insn, text);
+  g_free(text);
+
+  if (!valid)
+    return FALSE;
+
+  return expr_next(parser);
+}
+
+static gboolean
+expr_parse_not(expr_parser_t *parser)
+{
+  switch (parser->token)
+  {
+  case EXPR_TOKEN_NOT:
+    {
+      if (!expr_next(parser) || !expr_parse_not(parser))
+        return FALSE;
+
+      expr_emit(parser->expr, EXPR_OP_NOT);
+
+      return TRUE;
+    }
+
+  case EXPR_TOKEN_OPEN:
+    {
+      if (!expr_next(parser) || !expr_parse_or(parser))
+        return FALSE;
+
+      if (parser->token != EXPR_TOKEN_CLOSE)
+        return expr_error(parser, N_("')' expected"));
+
+      return expr_next(parser);
+    }
+
+  case EXPR_TOKEN_WORD:
+    return expr_parse_predicate(parser);
+
+  default:
+    return expr_error(parser, N_("predicate expected"));
+  }
+}
+
+static gboolean
+expr_parse_binary(expr_parser_t *parser, guint token, guint jump)
+{
+  GArray *jumps;
+  gboolean ret;
+  guint i, pc;
+
+  if (token == EXPR_TOKEN_OR)
+    ret = expr_parse_binary(parser, EXPR_TOKEN_AND, EXPR_OP_JUMP_FALSE);
+  else
+    ret = expr_parse_not(parser);
+
+  if (!ret || (parser->token != token))
+    return ret;
+
+  jumps = g_array_new(FALSE, FALSE, sizeof(guint));
+
+  while (ret && (parser->token == token))
+    {
+      pc = parser->expr->n_code;
+      g_array_append_val(jumps, pc);
+      expr_emit(parser->expr, jump);
+
+      ret = expr_next(parser);
+      if (!ret)
+        break;
+
+      if (token == EXPR_TOKEN_OR)
+        ret = expr_parse_binary(parser, EXPR_TOKEN_AND, EXPR_OP_JUMP_FALSE);
+      else
+        ret = expr_parse_not(parser);
+    }
+
+  for (i = 0; i < jumps->len; i++)
+    parser->expr->code[g_array_index(jumps, guint, i)].target =
+        parser->expr->n_code;
+
+  g_array_free(jumps, TRUE);
+
+  return ret;
+}
+
+static gboolean
+expr_parse_or(expr_parser_t *parser)
+{
+  return expr_parse_binary(parser, EXPR_TOKEN_OR, EXPR_OP_JUMP_TRUE);
+}
+
+static gboolean
+expr_compare(guint cmp, gint64 a, gint64 b)
+{
+  switch (cmp)
+  {
+  case EXPR_CMP_NE:
+    return a != b;
+
+  case EXPR_CMP_LT:
+    return a < b;
+
+  case EXPR_CMP_LE:
+    return a <= b;
+
+  case EXPR_CMP_GT:
+    return a > b;
+
+  case EXPR_CMP_GE:
+    return a >= b;
+
+  case EXPR_CMP_EQ:
+  default:
+    return a == b;
+  }
+}
+
+expr_t *
+expr_new(const gchar *text, GError **error)
+{
+  expr_parser_t parser;
+  expr_t *expr;
+
+  expr = g_new0(expr_t, 1);
+
+  memset(&parser, 0, sizeof(parser));
+  parser.expr = expr;
+  parser.input = text;
+  parser.p = text;
+  parser.error = error;
+
+  if (!expr_next(&parser) || !expr_parse_or(&parser))
+    {
+      expr_free(expr);
+
+      return NULL;
+    }
+
+  if (parser.token != EXPR_TOKEN_END)
+    {
+      expr_error(&parser, N_("end of expression expected"));
+      expr_free(expr);
+
+      return NULL;
+    }
+
+  return expr;
+}
+
+void
+expr_free(expr_t *expr)
+{
+  guint i;
+
+  if (!expr)
+    return;
+
+  for (i = 0; i < expr->n_code; i++)
+    {
+      g_free(expr->code[i].text);
+      pattern_set_free(expr->code[i].pattern);
+    }
+
+  g_free(expr->code);
+  g_free(expr);
+}
+
+gboolean
+expr_run(const expr_t *expr, const struct stat *st,
+    const watcher_event_t *event)
+{
+  const expr_insn_t *insn;
+  const gchar *name;
+  gboolean acc = TRUE;
+  gint64 now = 0;
+  guint pc = 0;
+
+  while (pc < expr->n_code)
+    {
+      insn = &expr->code[pc++];
+
+      switch (insn->op)
+      {
+      case EXPR_OP_SIZE:
+        acc = expr_compare(insn->cmp, (gint64) st->st_size, insn->value);
+        break;
+
+      case EXPR_OP_MTIME:
+      case EXPR_OP_CTIME:
+      case EXPR_OP_ATIME:
+        {
+          gint64 when;
+
+          if (!now)
+            now = (gint64) time(NULL);
+
+          if (insn->op == EXPR_OP_MTIME)
+            when = st->st_mtime;
+          else if (insn->op == EXPR_OP_CTIME)
+            when = st->st_ctime;
+          else
+            when = st->st_atime;
+
+          acc = expr_compare(insn->cmp, now - when, insn->value);
+
+          break;
+        }
+
+      case EXPR_OP_INODE:
+        acc = expr_compare(insn->cmp, (gint64) st->st_ino, insn->value);
+        break;
+
+      case EXPR_OP_NLINK:
+        acc = expr_compare(insn->cmp, (gint64) st->st_nlink, insn->value);
+        break;
+
+      case EXPR_OP_UID:
+        acc = expr_compare(insn->cmp, (gint64) st->st_uid, insn->value);
+        break;
+
+      case EXPR_OP_GID:
+        acc = expr_compare(insn->cmp, (gint64) st->st_gid, insn->value);
+        break;
+
+      case EXPR_OP_MODE:
+        {
+          if (insn->cmp == EXPR_CMP_ALL)
+            acc = (st->st_mode & insn->value) == insn->value;
+          else
+            acc = expr_compare(insn->cmp, st->st_mode & 07777, insn->value);
+
+          break;
+        }
+
+      case EXPR_OP_TYPE:
+        acc = ((st->st_mode & S_IFMT) == insn->value)
+            == (insn->cmp == EXPR_CMP_EQ);
+        break;
+
+      case EXPR_OP_PATH:
+      case EXPR_OP_NAME:
+        {
+          name = event->rfile;
+          if (insn->op == EXPR_OP_NAME)
+            {
+              name = strrchr(event->rfile, G_DIR_SEPARATOR);
+              name = name ? name + 1 : event->rfile;
+            }
+
+          if (insn->cmp == EXPR_CMP_MATCH)
+            acc = pattern_set_match(insn->pattern, name);
+          else
+            acc = (strcmp(name, insn->text) == 0)
+                == (insn->cmp == EXPR_CMP_EQ);
+
+          break;
+        }
+
+      case EXPR_OP_EVENT:
+        acc = ((event->mask & insn->value) != 0)
+            == (insn->cmp == EXPR_CMP_EQ);
+        break;
+
+      case EXPR_OP_NOT:
+        acc = !acc;
+        break;
+
+      case EXPR_OP_JUMP_FALSE:
+        if (!acc)
+          pc = insn->target;
+        break;
+
+      case EXPR_OP_JUMP_TRUE:
+        if (acc)
+          pc = insn->target;
+        break;
+
+      default:
+        break;
+      }
+    }
+
+  return acc;
+}
@@ -0,0 +1,81 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef EXPR_H_
+#define EXPR_H_
+
+#include "common.h"
+
+#include <sys/stat.h>
+
+struct _pattern_set_t;
+struct _watcher_event_t;
+
+typedef struct _expr_insn_t
+{
+  guint op;
+#define EXPR_OP_SIZE                    0
+#define EXPR_OP_MTIME                   1
+#define EXPR_OP_CTIME                   2
+#define EXPR_OP_ATIME                   3
+#define EXPR_OP_INODE                   4
+#define EXPR_OP_NLINK                   5
+#define EXPR_OP_UID                     6
+#define EXPR_OP_GID                     7
+#define EXPR_OP_MODE                    8
+#define EXPR_OP_TYPE                    9
+#define EXPR_OP_PATH                    10
+#define EXPR_OP_NAME                    11
+#define EXPR_OP_EVENT                   12
+#define EXPR_OP_NOT                     13
+#define EXPR_OP_JUMP_FALSE              14
+#define EXPR_OP_JUMP_TRUE               15
+  guint cmp;
+#define EXPR_CMP_EQ                     0
+#define EXPR_CMP_NE                     1
+#define EXPR_CMP_LT                     2
+#define EXPR_CMP_LE                     3
+#define EXPR_CMP_GT                     4
+#define EXPR_CMP_GE                     5
+#define EXPR_CMP_MATCH                  6
+#define EXPR_CMP_ALL                    7
+  gint64 value;
+  gchar *text;
+  struct _pattern_set_t *pattern;
+  guint target;
+} expr_insn_t;
+
+typedef struct _expr_t
+{
+  expr_insn_t *code;
+  guint n_code;
+  guint size;
+  gboolean stat;
+} expr_t;
+
+expr_t *
+expr_new(const gchar *text, GError **error);
+void
+expr_free(expr_t *expr);
+gboolean
+expr_run(const expr_t *expr, const struct stat *st,
+    const struct _watcher_event_t *event);
+
+#endif /* EXPR_H_ */
@@ -0,0 +1,475 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "fmon.h"
+#include "expr.h"
+#include "filter.h"
+#include "identity.h"
+#include "pattern.h"
+#include "statcache.h"
+#include "watcher.h"
+
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+static filter_op_t *
+filter_append(filter_t *filter, guint code)
+{
+  filter_op_t *op;
+
+  op = &filter->ops[filter->n_ops++];
+  op->code = code;
+
+  return op;
+}
+
+static mode_t
+filter_get_type(const gchar *type)
+{
+  if (g_strcmp0(type, CONFIG_KEY_WATCHER_TYPE_BLOCK) == 0)
+    return S_IFBLK;
+  if (g_strcmp0(type, CONFIG_KEY_WATCHER_TYPE_CHARACTER) == 0)
+    return S_IFCHR;
+  if (g_strcmp0(type, CONFIG_KEY_WATCHER_TYPE_DIRECTORY) == 0)
+    return S_IFDIR;
+  if (g_strcmp0(type, CONFIG_KEY_WATCHER_TYPE_FIFO) == 0)
+    return S_IFIFO;
+  if (g_strcmp0(type, CONFIG_KEY_WATCHER_TYPE_REGULAR) == 0)
+    return S_IFREG;
+  if (g_strcmp0(type, CONFIG_KEY_WATCHER_TYPE_SOCKET) == 0)
+    return S_IFSOCK;
+  if (g_strcmp0(type, CONFIG_KEY_WATCHER_TYPE_SYMBOLICLINK) == 0)
+    return S_IFLNK;
+
+  return 0;
+}
+
+static guint64
+filter_get_size(const watcher_t *watcher)
+{
+  guint64 size, unit;
+
+  size = (guint64) watcher->size;
+
+  switch (watcher->size_unit)
+  {
+  case WATCHER_SIZE_UNIT_KBYTES:
+    unit = G_GUINT64_CONSTANT(1024);
+    break;
+
+  case WATCHER_SIZE_UNIT_MBYTES:
+    unit = G_GUINT64_CONSTANT(1048576);
+    break;
+
+  case WATCHER_SIZE_UNIT_GBYTES:
+    unit = G_GUINT64_CONSTANT(1073741824);
+    break;
+
+  case WATCHER_SIZE_UNIT_BYTES:
+  default:
+    unit = 1;
+    break;
+  }
+
+  if (size > G_MAXUINT64 / unit)
+    return G_MAXUINT64;
+
+  return size * unit;
+}
+
+/*
+ * Evaluates access(2) from the mode bits of the stat buffer, with the real
+ * uid and gids of the process resolved once by filter_new(). ACLs are not
+ * considered.
+ */
+static gboolean
+filter_access(const filter_t *filter, const struct stat *st, guint mask)
+{
+  guint bits;
+  gint i;
+
+  if (filter->uid == 0)
+    {
+      if (!(mask & X_OK) || S_ISDIR(st->st_mode))
+        return TRUE;
+
+      return (st->st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)) != 0;
+    }
+
+  if (st->st_uid == filter->uid)
+    bits = (st->st_mode >> 6) & 7;
+  else
+    {
+      bits = st->st_mode & 7;
+
+      if (st->st_gid == filter->gid)
+        bits = (st->st_mode >> 3) & 7;
+      else
+        {
+          for (i = 0; i < filter->n_groups; i++)
+            {
+              if (st->st_gid == filter->groups[i])
+                {
+                  bits = (st->st_mode >> 3) & 7;
+
+                  break;
+                }
+            }
+        }
+    }
+
+  return (bits & mask) == mask;
+}
+
+filter_t *
+filter_new(watcher_t *watcher)
+{
+  filter_t *filter;
+  filter_op_t *op;
+  gint n_groups;
+
+  filter = g_new0(filter_t, 1);
+  filter->watcher = watcher;
+  filter->ops = g_new0(filter_op_t, FILTER_OP_EXPR + 1);
+  filter->uid = getuid();
+  filter->gid = getgid();
+
+  n_groups = getgroups(0, NULL);
+  if (n_groups > 0)
+    {
+      filter->groups = g_new0(gid_t, n_groups);
+      filter->n_groups = getgroups(n_groups, filter->groups);
+      if (filter->n_groups < 0)
+        filter->n_groups = 0;
+    }
+
+  /* tests without any syscall */
+
+  if (watcher->event_mask != WATCHER_EVENT_ALL)
+    {
+      op = filter_append(filter, FILTER_OP_EVENT);
+      op->mask = watcher->event_mask;
+    }
+
+  if (watcher->includes || watcher->excludes || watcher->include_regex
+      || watcher->exclude_regex)
+    {
+      filter->includes = pattern_set_new(watcher->includes);
+      filter->excludes = pattern_set_new(watcher->excludes);
+
+      filter_append(filter, FILTER_OP_PATTERN);
+    }
+
+  /* an expression without file predicate also applies to deleted files */
+  if (watcher->expr && !watcher->expr->stat)
+    filter_append(filter, FILTER_OP_EXPR);
+
+  /* tests on the stat buffer of the file */
+
+  filter_append(filter, FILTER_OP_STAT);
+
+  if (watcher->type)
+    {
+      op = filter_append(filter, FILTER_OP_TYPE);
+      op->type = filter_get_type(watcher->type);
+    }
+
+  if (watcher->size > -1)
+    {
+      op = filter_append(filter, FILTER_OP_SIZE);
+      op->size = filter_get_size(watcher);
+      op->cmp = watcher->size_cmp;
+    }
+
+  if (watcher->users)
+    {
+      op = filter_append(filter, FILTER_OP_USER);
+      op->identity = watcher->users;
+    }
+
+  if (watcher->groups)
+    {
+      op = filter_append(filter, FILTER_OP_GROUP);
+      op->identity = watcher->groups;
+    }
+
+  if (watcher->readable || watcher->writable || watcher->executable)
+    {
+      op = filter_append(filter, FILTER_OP_ACCESS);
+      op->mask = (watcher->readable ? R_OK : 0)
+          | (watcher->writable ? W_OK : 0)
+          | (watcher->executable ? X_OK : 0);
+    }
+
+  if (watcher->expr && watcher->expr->stat)
+    filter_append(filter, FILTER_OP_EXPR);
+
+  /* tests requiring another syscall */
+
+  if (watcher->mount)
+    filter_append(filter, FILTER_OP_MOUNT);
+
+  return filter;
+}
+
+void
+filter_free(filter_t *filter)
+{
+  if (!filter)
+    return;
+
+  pattern_set_free(filter->includes);
+  pattern_set_free(filter->excludes);
+  g_free(filter->groups);
+  g_free(filter->ops);
+  g_free(filter);
+}
+
+void
+filter_reset_root(filter_t *filter)
+{
+  if (filter)
+    filter->root_valid = FALSE;
+}
+
+gboolean
+filter_run(filter_t *filter, const watcher_event_t *event)
+{
+  struct stat st_file;
+  const filter_op_t *op;
+  guint i;
+  gint err;
+
+  for (i = 0; i < filter->n_ops; i++)
+    {
+      op = &filter->ops[i];
+
+      switch (op->code)
+      {
+      case FILTER_OP_EVENT:
+        {
+          if (!(op->mask & event->mask))
+            return FALSE;
+
+          break;
+        }
+
+      case FILTER_OP_PATTERN:
+        {
+          if ((filter->includes
+              && pattern_set_match(filter->includes, event->rfile))
+              || (filter->watcher->include_regex
+                  && g_regex_match(filter->watcher->include_regex,
+                      event->rfile, 0, NULL)))
+            {
+              LOG_DEBUG("%s", N_("relative filename found in include list"));
+
+              break;
+            }
+
+          if ((filter->excludes
+              && pattern_set_match(filter->excludes, event->rfile))
+              || (filter->watcher->exclude_regex
+                  && g_regex_match(filter->watcher->exclude_regex,
+                      event->rfile, 0, NULL)))
+            {
+              LOG_DEBUG("%s", N_("relative filename found in exclude list"));
+
+              return FALSE;
+            }
+
+          if (filter->includes || filter->watcher->include_regex)
+            return FALSE;
+
+          break;
+        }
+
+      case FILTER_OP_STAT:
+        {
+          if (event->mask & (WATCHER_EVENT_DELETED | WATCHER_EVENT_UNMOUNTED))
+            return TRUE;
+
+          err = statcache_stat(event->file, &st_file);
+          if (err == ENOENT)
+            {
+              LOG_DEBUG("%s '%s'", N_("the watched file vanished"), event->file);
+
+              return FALSE;
+            }
+          else if (err != 0)
+            {
+              LOG_ERROR("%s '%s' (%s)", N_("failed to stat the watched file"),
+                  event->file, g_strerror(err));
+
+              return FALSE;
+            }
+
+          break;
+        }
+
+      case FILTER_OP_TYPE:
+        {
+          if ((st_file.st_mode & S_IFMT) != op->type)
+            {
+              LOG_DEBUG("%s", N_("the file type doesn't match"));
+
+              return FALSE;
+            }
+
+          break;
+        }
+
+      case FILTER_OP_SIZE:
+        {
+          guint64 size;
+
+          if (S_ISDIR(st_file.st_mode))
+            break;
+
+          size = (guint64) st_file.st_size;
+
+          switch (op->cmp)
+          {
+          case WATCHER_SIZE_COMPARE_GREATER:
+            {
+              if (size <= op->size)
+                {
+                  LOG_DEBUG("%s", N_("the file size is not greater"));
+
+                  return FALSE;
+                }
+
+              break;
+            }
+
+          case WATCHER_SIZE_COMPARE_LESS:
+            {
+              if (size >= op->size)
+                {
+                  LOG_DEBUG("%s", N_("the file size is not less"));
+
+                  return FALSE;
+                }
+
+              break;
+            }
+
+          case WATCHER_SIZE_COMPARE_EQUAL:
+          default:
+            {
+              if (size != op->size)
+                {
+                  LOG_DEBUG("%s", N_("the file size is not equal"));
+
+                  return FALSE;
+                }
+
+              break;
+            }
+          }
+
+          break;
+        }
+
+      case FILTER_OP_USER:
+        {
+          if (!identity_match(op->identity, st_file.st_uid))
+            {
+              LOG_DEBUG("%s", N_("the owner user doesn't match"));
+
+              return FALSE;
+            }
+
+          break;
+        }
+
+      case FILTER_OP_GROUP:
+        {
+          if (!identity_match(op->identity, st_file.st_gid))
+            {
+              LOG_DEBUG("%s", N_("the owner group doesn't match"));
+
+              return FALSE;
+            }
+
+          break;
+        }
+
+      case FILTER_OP_ACCESS:
+        {
+          if (!filter_access(filter, &st_file, op->mask))
+            {
+              LOG_DEBUG("%s", N_("the file access doesn't match"));
+
+              return FALSE;
+            }
+
+          break;
+        }
+
+      case FILTER_OP_MOUNT:
+        {
+          if (!filter->root_valid)
+            {
+              struct stat st_path;
+
+              if (g_stat(filter->watcher->path, &st_path) != 0)
+                {
+                  LOG_ERROR("%s '%s'", N_("failed to stat the watcher path"),
+                      filter->watcher->path);
+
+                  return FALSE;
+                }
+
+              filter->root_dev = st_path.st_dev;
+              filter->root_valid = TRUE;
+            }
+
+          if (st_file.st_dev != filter->root_dev)
+            {
+              LOG_DEBUG("%s", N_("the filesystems are not the same"));
+
+              return FALSE;
+            }
+
+          break;
+        }
+
+      case FILTER_OP_EXPR:
+        {
+          if (!expr_run(filter->watcher->expr, &st_file, event))
+            {
+              LOG_DEBUG("%s", N_("the filter expression doesn't match"));
+
+              return FALSE;
+            }
+
+          break;
+        }
+
+      default:
+        break;
+      }
+    }
+
+  return TRUE;
+}
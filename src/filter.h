@@ -0,0 +1,77 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef FILTER_H_
+#define FILTER_H_
+
+#include "common.h"
+
+#include <sys/types.h>
+
+struct _identity_t;
+struct _pattern_set_t;
+struct _watcher_t;
+struct _watcher_event_t;
+
+typedef struct _filter_op_t
+{
+  guint code;
+#define FILTER_OP_EVENT                 0
+#define FILTER_OP_PATTERN               1
+#define FILTER_OP_STAT                  2
+#define FILTER_OP_TYPE                  3
+#define FILTER_OP_SIZE                  4
+#define FILTER_OP_USER                  5
+#define FILTER_OP_GROUP                 6
+#define FILTER_OP_ACCESS                7
+#define FILTER_OP_MOUNT                 8
+#define FILTER_OP_EXPR                  9
+  guint mask;
+  guint cmp;
+  guint64 size;
+  mode_t type;
+  struct _identity_t *identity;
+} filter_op_t;
+
+typedef struct _filter_t
+{
+  struct _watcher_t *watcher;
+  filter_op_t *ops;
+  guint n_ops;
+  struct _pattern_set_t *includes;
+  struct _pattern_set_t *excludes;
+  uid_t uid;
+  gid_t gid;
+  gid_t *groups;
+  gint n_groups;
+  dev_t root_dev;
+  gboolean root_valid;
+} filter_t;
+
+filter_t *
+filter_new(struct _watcher_t *watcher);
+void
+filter_free(filter_t *filter);
+void
+filter_reset_root(filter_t *filter);
+gboolean
+filter_run(filter_t *filter, const struct _watcher_event_t *event);
+
+#endif /* FILTER_H_ */
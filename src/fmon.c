@@ -19,17 +19,36 @@
  */
 
 #include "fmon.h"
+#include "attach.h"
+#include "batch.h"
+#include "coalesce.h"
+#include "command.h"
 #include "daemon.h"
+#include "expr.h"
+#include "filter.h"
+#include "identity.h"
+#include "jobs.h"
 #include "log.h"
 #include "log_console.h"
 #include "log_file.h"
 #include "log_syslog.h"
+#include "monitor_fanotify.h"
+#include "monitor_inotify.h"
 #include "mount.h"
+#include "notify.h"
+#include "pattern.h"
+#include "polling.h"
+#include "queue.h"
+#include "rescan.h"
+#include "statcache.h"
+#include "tree.h"
 #include "watcher.h"
+#include "workers.h"
 
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 
 application_t *app = NULL;
 
@@ -210,15 +229,27 @@ reload_config()
   return TRUE;
 }
 
+static gint
+compare_watchers(gconstpointer a, gconstpointer b)
+{
+  gint pa, pb;
+
+  pa = ((const watcher_t *) a)->priority;
+  pb = ((const watcher_t *) b)->priority;
+
+  return (pa < pb) - (pa > pb);
+}
+
 GSList *
 init_watchers()
 {
   GSList *list = NULL;
   GError *error = NULL;
-  gchar **groups;
+  gchar **groups, **value_list;
   gchar *value;
-  gsize len;
-  gint i;
+  gsize len, path_len;
+  gint i, j, coalesce, jobs, timeout, batch, delay, workers, backlog, ttl;
+  gint size;
 
   groups = g_key_file_get_groups(app->settings, &len);
   if (len < 2)
@@ -249,8 +280,7 @@ init_watchers()
 
           g_error_free(error);
           error = NULL;
-          g_free(watcher->name);
-          g_free(watcher);
+          watcher_free(watcher);
           g_strfreev(groups);
 
           return NULL;
@@ -259,9 +289,7 @@ init_watchers()
         {
           g_printerr("%s: %s\n", watcher->name, N_("file/path doesn't exist"));
 
-          g_free(watcher->path);
-          g_free(watcher->name);
-          g_free(watcher);
+          watcher_free(watcher);
           g_strfreev(groups);
 
           return NULL;
@@ -273,9 +301,7 @@ init_watchers()
               g_printerr("%s: %s\n", watcher->name,
                   N_("bad permissions on file"));
 
-              g_free(watcher->path);
-              g_free(watcher->name);
-              g_free(watcher);
+              watcher_free(watcher);
               g_strfreev(groups);
 
               return NULL;
@@ -288,15 +314,73 @@ init_watchers()
               g_printerr("%s: %s\n", watcher->name,
                   N_("bad permissions on path"));
 
-              g_free(watcher->path);
-              g_free(watcher->name);
-              g_free(watcher);
+              watcher_free(watcher);
               g_strfreev(groups);
 
               return NULL;
             }
         }
 
+      path_len = strlen(watcher->path);
+      while ((path_len > 1)
+          && (watcher->path[path_len - 1] == G_DIR_SEPARATOR))
+        watcher->path[--path_len] = '\0';
+
+      value = g_key_file_get_string(app->settings, watcher->name,
+          CONFIG_KEY_WATCHER_BACKEND, &error);
+      if (error)
+        {
+          value = g_strdup(CONFIG_KEY_WATCHER_BACKEND_DEFAULT);
+
+          g_error_free(error);
+          error = NULL;
+        }
+      if (g_strcmp0(value, CONFIG_KEY_WATCHER_BACKEND_GIO) == 0)
+        watcher->backend = WATCHER_BACKEND_GIO;
+#ifdef OS_LINUX
+      else if (g_strcmp0(value, CONFIG_KEY_WATCHER_BACKEND_INOTIFY) == 0)
+        watcher->backend = WATCHER_BACKEND_INOTIFY;
+#endif
+#ifdef MONITOR_FANOTIFY_SUPPORTED
+      else if (g_strcmp0(value, CONFIG_KEY_WATCHER_BACKEND_FANOTIFY) == 0)
+        watcher->backend = WATCHER_BACKEND_FANOTIFY;
+#endif
+      else
+        {
+          g_printerr("%s: %s\n", watcher->name, N_("invalid backend"));
+
+          g_free(value);
+          watcher_free(watcher);
+          g_strfreev(groups);
+
+          return NULL;
+        }
+
+      g_free(value);
+
+#ifdef MONITOR_FANOTIFY_SUPPORTED
+      /* the kernel reports the files by their canonical path */
+      if (watcher->backend == WATCHER_BACKEND_FANOTIFY)
+        {
+          gchar *real_path;
+
+          real_path = realpath(watcher->path, NULL);
+          if (!real_path)
+            {
+              g_printerr("%s: %s\n", watcher->name, N_("invalid path"));
+
+              watcher_free(watcher);
+              g_strfreev(groups);
+
+              return NULL;
+            }
+
+          g_free(watcher->path);
+          watcher->path = g_strdup(real_path);
+          free(real_path);
+        }
+#endif
+
       watcher->recursive = g_key_file_get_boolean(app->settings, watcher->name,
           CONFIG_KEY_WATCHER_RECURSIVE, &error);
       if (error)
@@ -314,9 +398,7 @@ init_watchers()
               g_printerr("%s: %s\n", watcher->name,
                   N_("recursion is enabled but path is not a directory"));
 
-              g_free(watcher->path);
-              g_free(watcher->name);
-              g_free(watcher);
+              watcher_free(watcher);
               g_strfreev(groups);
 
               return NULL;
@@ -336,9 +418,7 @@ init_watchers()
               g_printerr("%s: %s\n", watcher->name,
                   N_("invalid maximum depth of recursion"));
 
-              g_free(watcher->path);
-              g_free(watcher->name);
-              g_free(watcher);
+              watcher_free(watcher);
               g_strfreev(groups);
 
               return NULL;
@@ -346,7 +426,7 @@ init_watchers()
         }
 
       watcher->events = g_key_file_get_string_list(app->settings, watcher->name,
-          CONFIG_KEY_WATCHER_EVENTS, &len, &error);
+          CONFIG_KEY_WATCHER_EVENTS, NULL, &error);
       if (error)
         {
           g_error_free(error);
@@ -354,35 +434,145 @@ init_watchers()
         }
       if (watcher->events)
         {
-          for (i = 0; watcher->events[i]; i++)
+          for (j = 0; watcher->events[j]; j++)
             {
-              if ((g_strcmp0(watcher->events[i],
-                  CONFIG_KEY_WATCHER_EVENT_CHANGING) != 0)
-                  && (g_strcmp0(watcher->events[i],
-                  CONFIG_KEY_WATCHER_EVENT_CHANGED) != 0)
-                  && (g_strcmp0(watcher->events[i],
-                      CONFIG_KEY_WATCHER_EVENT_CREATED) != 0)
-                  && (g_strcmp0(watcher->events[i],
-                      CONFIG_KEY_WATCHER_EVENT_DELETED) != 0)
-                  && (g_strcmp0(watcher->events[i],
-                      CONFIG_KEY_WATCHER_EVENT_ATTRIBUTECHANGED) != 0)
-                  && (g_strcmp0(watcher->events[i],
-                      CONFIG_KEY_WATCHER_EVENT_MOUNTED) != 0)
-                  && (g_strcmp0(watcher->events[i],
-                      CONFIG_KEY_WATCHER_EVENT_UNMOUNTED) != 0))
+              if (g_strcmp0(watcher->events[j],
+                  CONFIG_KEY_WATCHER_EVENT_CHANGING) == 0)
+                watcher->event_mask |= WATCHER_EVENT_CHANGING;
+              else if (g_strcmp0(watcher->events[j],
+                  CONFIG_KEY_WATCHER_EVENT_CHANGED) == 0)
+                watcher->event_mask |= WATCHER_EVENT_CHANGED;
+              else if (g_strcmp0(watcher->events[j],
+                  CONFIG_KEY_WATCHER_EVENT_CREATED) == 0)
+                watcher->event_mask |= WATCHER_EVENT_CREATED;
+              else if (g_strcmp0(watcher->events[j],
+                  CONFIG_KEY_WATCHER_EVENT_DELETED) == 0)
+                watcher->event_mask |= WATCHER_EVENT_DELETED;
+              else if (g_strcmp0(watcher->events[j],
+                  CONFIG_KEY_WATCHER_EVENT_ATTRIBUTECHANGED) == 0)
+                watcher->event_mask |= WATCHER_EVENT_ATTRIBUTECHANGED;
+              else if (g_strcmp0(watcher->events[j],
+                  CONFIG_KEY_WATCHER_EVENT_MOUNTED) == 0)
+                watcher->event_mask |= WATCHER_EVENT_MOUNTED;
+              else if (g_strcmp0(watcher->events[j],
+                  CONFIG_KEY_WATCHER_EVENT_UNMOUNTED) == 0)
+                watcher->event_mask |= WATCHER_EVENT_UNMOUNTED;
+              else
                 {
                   g_printerr("%s: %s\n", watcher->name, N_("invalid event"));
 
-                  g_strfreev(watcher->events);
-                  g_free(watcher->path);
-                  g_free(watcher->name);
-                  g_free(watcher);
+                  watcher_free(watcher);
                   g_strfreev(groups);
 
                   return NULL;
                 }
             }
         }
+      else
+        {
+          watcher->event_mask = WATCHER_EVENT_ALL;
+        }
+
+      coalesce = g_key_file_get_integer(app->settings, watcher->name,
+          CONFIG_KEY_WATCHER_COALESCE, &error);
+      if (error)
+        {
+          coalesce = CONFIG_KEY_WATCHER_COALESCE_DEFAULT;
+
+          g_error_free(error);
+          error = NULL;
+        }
+      if (coalesce < 0)
+        {
+          g_printerr("%s: %s\n", watcher->name, N_("invalid coalesce delay"));
+
+          watcher_free(watcher);
+          g_strfreev(groups);
+
+          return NULL;
+        }
+
+      watcher->coalesce = coalesce;
+
+      size = g_key_file_get_integer(app->settings, watcher->name,
+          CONFIG_KEY_WATCHER_QUEUESIZE, &error);
+      if (error)
+        {
+          size = CONFIG_KEY_WATCHER_QUEUESIZE_DEFAULT;
+
+          g_error_free(error);
+          error = NULL;
+        }
+      if (size < 0)
+        {
+          g_printerr("%s: %s\n", watcher->name, N_("invalid queue size"));
+
+          watcher_free(watcher);
+          g_strfreev(groups);
+
+          return NULL;
+        }
+
+      watcher->queue_size = size;
+
+      value = g_key_file_get_string(app->settings, watcher->name,
+          CONFIG_KEY_WATCHER_QUEUEPOLICY, &error);
+      if (error)
+        {
+          g_error_free(error);
+          error = NULL;
+        }
+      if (!value
+          || (g_strcmp0(value, CONFIG_KEY_WATCHER_QUEUEPOLICY_BLOCK) == 0))
+        watcher->queue_policy = QUEUE_POLICY_BLOCK;
+      else if (g_strcmp0(value, CONFIG_KEY_WATCHER_QUEUEPOLICY_DROPOLDEST) == 0)
+        watcher->queue_policy = QUEUE_POLICY_DROP_OLDEST;
+      else if (g_strcmp0(value, CONFIG_KEY_WATCHER_QUEUEPOLICY_DROPNEWEST) == 0)
+        watcher->queue_policy = QUEUE_POLICY_DROP_NEWEST;
+      else if (g_strcmp0(value, CONFIG_KEY_WATCHER_QUEUEPOLICY_RESCAN) == 0)
+        watcher->queue_policy = QUEUE_POLICY_RESCAN;
+      else
+        {
+          g_printerr("%s: %s\n", watcher->name, N_("invalid queue policy"));
+
+          g_free(value);
+          watcher_free(watcher);
+          g_strfreev(groups);
+
+          return NULL;
+        }
+      g_free(value);
+
+      watcher->priority = g_key_file_get_integer(app->settings, watcher->name,
+          CONFIG_KEY_WATCHER_PRIORITY, &error);
+      if (error)
+        {
+          watcher->priority = CONFIG_KEY_WATCHER_PRIORITY_DEFAULT;
+
+          g_error_free(error);
+          error = NULL;
+        }
+
+      delay = g_key_file_get_integer(app->settings, watcher->name,
+          CONFIG_KEY_WATCHER_POLLINTERVAL, &error);
+      if (error)
+        {
+          delay = CONFIG_KEY_WATCHER_POLLINTERVAL_DEFAULT;
+
+          g_error_free(error);
+          error = NULL;
+        }
+      if (delay <= 0)
+        {
+          g_printerr("%s: %s\n", watcher->name, N_("invalid poll interval"));
+
+          watcher_free(watcher);
+          g_strfreev(groups);
+
+          return NULL;
+        }
+
+      watcher->poll_interval = delay;
 
       watcher->exec = g_key_file_get_string(app->settings, watcher->name,
           CONFIG_KEY_WATCHER_EXEC, &error);
@@ -391,6 +581,180 @@ init_watchers()
           g_error_free(error);
           error = NULL;
         }
+      if (watcher->exec)
+        {
+          watcher->command = command_new(watcher->exec, &error);
+          if (error)
+            {
+              g_printerr("%s: %s (%s)\n", watcher->name,
+                  N_("invalid command"), error->message);
+
+              g_error_free(error);
+              error = NULL;
+              watcher_free(watcher);
+              g_strfreev(groups);
+
+              return NULL;
+            }
+        }
+
+      jobs = g_key_file_get_integer(app->settings, watcher->name,
+          CONFIG_KEY_WATCHER_MAXJOBS, &error);
+      if (error)
+        {
+          jobs = CONFIG_KEY_WATCHER_MAXJOBS_DEFAULT;
+
+          g_error_free(error);
+          error = NULL;
+        }
+
+      timeout = g_key_file_get_integer(app->settings, watcher->name,
+          CONFIG_KEY_WATCHER_JOBTIMEOUT, &error);
+      if (error)
+        {
+          timeout = CONFIG_KEY_WATCHER_JOBTIMEOUT_DEFAULT;
+
+          g_error_free(error);
+          error = NULL;
+        }
+
+      if ((jobs < 0) || (timeout < 0))
+        {
+          g_printerr("%s: %s\n", watcher->name, N_("invalid command jobs"));
+
+          watcher_free(watcher);
+          g_strfreev(groups);
+
+          return NULL;
+        }
+
+      watcher->max_jobs = jobs;
+      watcher->job_timeout = timeout;
+
+      batch = g_key_file_get_integer(app->settings, watcher->name,
+          CONFIG_KEY_WATCHER_EXECBATCH, &error);
+      if (error)
+        {
+          batch = CONFIG_KEY_WATCHER_EXECBATCH_DEFAULT;
+
+          g_error_free(error);
+          error = NULL;
+        }
+
+      delay = g_key_file_get_integer(app->settings, watcher->name,
+          CONFIG_KEY_WATCHER_EXECBATCHDELAY, &error);
+      if (error)
+        {
+          delay = CONFIG_KEY_WATCHER_EXECBATCHDELAY_DEFAULT;
+
+          g_error_free(error);
+          error = NULL;
+        }
+
+      if ((batch < 0) || (delay <= 0))
+        {
+          g_printerr("%s: %s\n", watcher->name, N_("invalid command batch"));
+
+          watcher_free(watcher);
+          g_strfreev(groups);
+
+          return NULL;
+        }
+
+      watcher->exec_batch = batch;
+      watcher->exec_batch_delay = delay;
+
+      watcher->exec_batch0 = g_key_file_get_boolean(app->settings,
+          watcher->name, CONFIG_KEY_WATCHER_EXECBATCH0, &error);
+      if (error)
+        {
+          watcher->exec_batch0 = CONFIG_KEY_WATCHER_EXECBATCH0_DEFAULT;
+
+          g_error_free(error);
+          error = NULL;
+        }
+
+      value = g_key_file_get_string(app->settings, watcher->name,
+          CONFIG_KEY_WATCHER_EXECMODE, &error);
+      if (error)
+        {
+          g_error_free(error);
+          error = NULL;
+        }
+      if (!value || (g_strcmp0(value, CONFIG_KEY_WATCHER_EXECMODE_SPAWN) == 0))
+        watcher->exec_mode = WATCHER_EXEC_MODE_SPAWN;
+      else if (g_strcmp0(value, CONFIG_KEY_WATCHER_EXECMODE_PERSISTENT) == 0)
+        watcher->exec_mode = WATCHER_EXEC_MODE_PERSISTENT;
+      else
+        {
+          g_printerr("%s: %s\n", watcher->name, N_("invalid command mode"));
+
+          g_free(value);
+          watcher_free(watcher);
+          g_strfreev(groups);
+
+          return NULL;
+        }
+      g_free(value);
+
+      value = g_key_file_get_string(app->settings, watcher->name,
+          CONFIG_KEY_WATCHER_EXECFRAMING, &error);
+      if (error)
+        {
+          g_error_free(error);
+          error = NULL;
+        }
+      if (!value
+          || (g_strcmp0(value, CONFIG_KEY_WATCHER_EXECFRAMING_NEWLINE) == 0))
+        watcher->exec_framing = WORKERS_FRAMING_NEWLINE;
+      else if (g_strcmp0(value, CONFIG_KEY_WATCHER_EXECFRAMING_NULL) == 0)
+        watcher->exec_framing = WORKERS_FRAMING_NULL;
+      else if (g_strcmp0(value, CONFIG_KEY_WATCHER_EXECFRAMING_LENGTH) == 0)
+        watcher->exec_framing = WORKERS_FRAMING_LENGTH;
+      else
+        {
+          g_printerr("%s: %s\n", watcher->name, N_("invalid command framing"));
+
+          g_free(value);
+          watcher_free(watcher);
+          g_strfreev(groups);
+
+          return NULL;
+        }
+      g_free(value);
+
+      workers = g_key_file_get_integer(app->settings, watcher->name,
+          CONFIG_KEY_WATCHER_EXECWORKERS, &error);
+      if (error)
+        {
+          workers = CONFIG_KEY_WATCHER_EXECWORKERS_DEFAULT;
+
+          g_error_free(error);
+          error = NULL;
+        }
+
+      backlog = g_key_file_get_integer(app->settings, watcher->name,
+          CONFIG_KEY_WATCHER_EXECBACKLOG, &error);
+      if (error)
+        {
+          backlog = CONFIG_KEY_WATCHER_EXECBACKLOG_DEFAULT;
+
+          g_error_free(error);
+          error = NULL;
+        }
+
+      if ((workers <= 0) || (backlog <= 0))
+        {
+          g_printerr("%s: %s\n", watcher->name, N_("invalid command workers"));
+
+          watcher_free(watcher);
+          g_strfreev(groups);
+
+          return NULL;
+        }
+
+      watcher->exec_workers = workers;
+      watcher->exec_backlog = backlog;
 
       watcher->print = g_key_file_get_boolean(app->settings, watcher->name,
           CONFIG_KEY_WATCHER_PRINT, &error);
@@ -482,11 +846,7 @@ init_watchers()
                       g_match_info_free(match_info);
                       g_regex_unref(regex_size);
                       g_free(value);
-                      g_free(watcher->exec);
-                      g_strfreev(watcher->events);
-                      g_free(watcher->path);
-                      g_free(watcher->name);
-                      g_free(watcher);
+                      watcher_free(watcher);
                       g_strfreev(groups);
 
                       return NULL;
@@ -502,7 +862,8 @@ init_watchers()
                 }
 
               str = g_match_info_fetch(match_info, 2);
-              watcher->size = (int) strtol (str, &err, 10);
+              errno = 0;
+              watcher->size = g_ascii_strtoll(str, &err, 10);
               if ((err == str) || (errno == ERANGE))
                 {
                   g_printerr("%s: %s\n", watcher->name, N_("invalid size"));
@@ -511,11 +872,7 @@ init_watchers()
                   g_match_info_free(match_info);
                   g_regex_unref(regex_size);
                   g_free(value);
-                  g_free(watcher->exec);
-                  g_strfreev(watcher->events);
-                  g_free(watcher->path);
-                  g_free(watcher->name);
-                  g_free(watcher);
+                  watcher_free(watcher);
                   g_strfreev(groups);
 
                   return NULL;
@@ -538,11 +895,7 @@ init_watchers()
                       g_match_info_free(match_info);
                       g_regex_unref(regex_size);
                       g_free(value);
-                      g_free(watcher->exec);
-                      g_strfreev(watcher->events);
-                      g_free(watcher->path);
-                      g_free(watcher->name);
-                      g_free(watcher);
+                      watcher_free(watcher);
                       g_strfreev(groups);
 
                       return NULL ;
@@ -570,10 +923,7 @@ init_watchers()
               g_match_info_free(match_info);
               g_regex_unref(regex_size);
               g_free(value);
-              g_strfreev(watcher->events);
-              g_free(watcher->path);
-              g_free(watcher->name);
-              g_free(watcher);
+              watcher_free(watcher);
               g_strfreev(groups);
 
               return NULL;
@@ -603,10 +953,7 @@ init_watchers()
 
           g_error_free(error);
           error = NULL;
-          g_strfreev(watcher->events);
-          g_free(watcher->path);
-          g_free(watcher->name);
-          g_free(watcher);
+          watcher_free(watcher);
           g_strfreev(groups);
 
           return NULL;
@@ -628,6 +975,39 @@ init_watchers()
           error = NULL;
         }
 
+      ttl = g_key_file_get_integer(app->settings, watcher->name,
+          CONFIG_KEY_WATCHER_IDENTITYTTL, &error);
+      if (error)
+        {
+          ttl = CONFIG_KEY_WATCHER_IDENTITYTTL_DEFAULT;
+
+          g_error_free(error);
+          error = NULL;
+        }
+      if (ttl < 0)
+        ttl = CONFIG_KEY_WATCHER_IDENTITYTTL_DEFAULT;
+
+      watcher->identity_ttl = ttl;
+
+      if (watcher->user)
+        watcher->users = identity_new(IDENTITY_KIND_USER, watcher->user,
+            watcher->identity_ttl);
+
+      if (watcher->group)
+        watcher->groups = identity_new(IDENTITY_KIND_GROUP, watcher->group,
+            watcher->identity_ttl);
+
+      if ((watcher->user && !watcher->users)
+          || (watcher->group && !watcher->groups))
+        {
+          g_printerr("%s: %s\n", watcher->name, N_("invalid owner"));
+
+          watcher_free(watcher);
+          g_strfreev(groups);
+
+          return NULL;
+        }
+
       watcher->includes = g_key_file_get_string_list(app->settings,
           watcher->name, CONFIG_KEY_WATCHER_INCLUDE, NULL, &error);
       if (error)
@@ -644,14 +1024,96 @@ init_watchers()
           error = NULL;
         }
 
-      watcher->monitors = g_hash_table_new(g_str_hash, g_str_equal);
+      /* the raw values keep the backslashes of the expressions */
+      for (j = 0; j < 2; j++)
+        {
+          GRegex *regex;
+
+          value = g_key_file_get_value(app->settings, watcher->name,
+              j ? CONFIG_KEY_WATCHER_EXCLUDEREGEX
+                : CONFIG_KEY_WATCHER_INCLUDEREGEX, &error);
+          if (error)
+            {
+              g_error_free(error);
+              error = NULL;
+
+              continue;
+            }
+
+          regex = pattern_regex_new(value, &error);
+          g_free(value);
+          if (error)
+            {
+              g_printerr("%s: %s (%s)\n", watcher->name,
+                  N_("invalid regular expression"), error->message);
+
+              g_error_free(error);
+              error = NULL;
+              watcher_free(watcher);
+              g_strfreev(groups);
+
+              return NULL;
+            }
+
+          if (j)
+            watcher->exclude_regex = regex;
+          else
+            watcher->include_regex = regex;
+        }
+
+      value = g_key_file_get_value(app->settings, watcher->name,
+          CONFIG_KEY_WATCHER_FILTER, &error);
+      if (error)
+        {
+          g_error_free(error);
+          error = NULL;
+        }
+      else
+        {
+          watcher->expr = expr_new(value, &error);
+          g_free(value);
+          if (error)
+            {
+              g_printerr("%s: %s (%s)\n", watcher->name,
+                  N_("invalid filter"), error->message);
+
+              g_error_free(error);
+              error = NULL;
+              watcher_free(watcher);
+              g_strfreev(groups);
+
+              return NULL;
+            }
+        }
+
+      value_list = g_key_file_get_string_list(app->settings, watcher->name,
+          CONFIG_KEY_WATCHER_PRUNE, NULL, &error);
+      if (error)
+        {
+          g_error_free(error);
+          error = NULL;
+        }
+      if (value_list)
+        {
+          watcher->prunes = g_new0(GPatternSpec *,
+              g_strv_length(value_list) + 1);
+
+          for (j = 0; value_list[j]; j++)
+            watcher->prunes[j] = g_pattern_spec_new(value_list[j]);
+
+          g_strfreev(value_list);
+        }
+
+      watcher->filter = filter_new(watcher);
+      watcher->monitors = tree_new(watcher->path, watcher);
 
       list = g_slist_append(list, watcher);
     }
 
   g_strfreev(groups);
 
-  return list;
+  /* the watchers with the highest priority claim the watch budget first */
+  return g_slist_sort(list, compare_watchers);
 }
 
 logger_t *
@@ -835,7 +1297,9 @@ void
 start_monitors()
 {
   GSList *item;
+  GError *error = NULL;
   watcher_t *watcher;
+  gint threads;
 
   if (app->started)
     {
@@ -846,15 +1310,65 @@ start_monitors()
 
   LOG_INFO("%s", N_("starting watchers"));
 
+  threads = g_key_file_get_integer(app->settings, CONFIG_GROUP_MAIN,
+      CONFIG_KEY_MAIN_CRAWLERTHREADS, &error);
+  if (error || (threads < 0))
+    {
+      threads = CONFIG_KEY_MAIN_CRAWLERTHREADS_DEFAULT;
+
+      if (error)
+        {
+          g_error_free(error);
+          error = NULL;
+        }
+    }
+
+  app->crawler_threads = threads;
+
   mount_create();
 
   LOG_INFO("%s", N_("mount watcher started"));
 
+#ifdef OS_LINUX
   for (item = app->watchers; item; item = item->next)
     {
       watcher = (watcher_t *) item->data;
 
-      if (watcher->recursive)
+#ifdef MONITOR_FANOTIFY_SUPPORTED
+      if ((watcher->backend == WATCHER_BACKEND_FANOTIFY)
+          && !monitor_fanotify_create(watcher))
+        {
+          LOG_ERROR("%s: %s",
+              watcher->name, N_("falling back to the inotify backend"));
+
+          watcher->backend = WATCHER_BACKEND_INOTIFY;
+        }
+#endif
+
+      if (watcher->backend != WATCHER_BACKEND_INOTIFY)
+        continue;
+
+      if (!app->inotify && !monitor_inotify_create())
+        {
+          LOG_ERROR("%s: %s",
+              watcher->name, N_("falling back to the GIO backend"));
+
+          watcher->backend = WATCHER_BACKEND_GIO;
+        }
+    }
+#endif
+
+  for (item = app->watchers; item; item = item->next)
+    {
+      watcher = (watcher_t *) item->data;
+
+      /* the initial crawl runs from the main loop, breadth first */
+      if (watcher->recursive && (watcher->backend != WATCHER_BACKEND_FANOTIFY)
+          && attach_crawl(watcher))
+        {
+          LOG_INFO("%s: %s", watcher->name, N_("initial crawl started"));
+        }
+      else if (watcher->recursive)
         {
           watcher_add_monitor_for_recursive_path(watcher, watcher->path, 1);
         }
@@ -863,12 +1377,37 @@ start_monitors()
           watcher_add_monitor_for_path(watcher, watcher->path);
         }
 
+      if (watcher->queue_size > 0)
+        watcher->queue = queue_new(watcher, watcher->queue_size,
+            watcher->queue_policy);
+
+      if (watcher->coalesce > 0)
+        watcher->coalescer = coalesce_new(watcher, watcher->coalesce);
+
+      if (watcher->command
+          && (watcher->exec_mode == WATCHER_EXEC_MODE_PERSISTENT))
+        {
+          watcher->workers = workers_new(watcher, watcher->exec_workers,
+              watcher->exec_framing, watcher->exec_backlog);
+        }
+      else if (watcher->command)
+        {
+          watcher->jobs = jobs_new(watcher, watcher->max_jobs,
+              watcher->job_timeout);
+
+          if (watcher->exec_batch > 0)
+            watcher->batch = batch_new(watcher);
+        }
+
       LOG_INFO("%s: %s", watcher->name, N_("watcher started"));
 
       watcher_list_monitors(watcher);
     }
 
   app->started = TRUE;
+
+  if (!app->crawling)
+    notify_ready();
 }
 
 void
@@ -896,9 +1435,37 @@ stop_monitors()
 
       watcher_destroy_monitors(watcher);
 
+      /* the pending events are delivered before stopping, and the commands
+       * they fire, batches included, still wait for MaxJobs: jobs_free()
+       * drains them while the main loop runs and drops them on exit */
+      coalesce_free(watcher->coalescer);
+      watcher->coalescer = NULL;
+
+      queue_free(watcher->queue);
+      watcher->queue = NULL;
+
+      rescan_cancel(watcher);
+
+      batch_free(watcher->batch);
+      watcher->batch = NULL;
+
+      jobs_free(watcher->jobs);
+      watcher->jobs = NULL;
+
+      workers_free(watcher->workers);
+      watcher->workers = NULL;
+
       LOG_INFO("%s: %s", watcher->name, N_("watcher stopped"));
     }
 
+#ifdef OS_LINUX
+  monitor_inotify_destroy();
+#endif
+
+  statcache_clear();
+
+  notify_stopped();
+
   app->started = FALSE;
 }
 
@@ -922,7 +1489,28 @@ list_monitors()
       watcher = (watcher_t *) item->data;
 
       watcher_list_monitors(watcher);
+
+      if (watcher->queue)
+        queue_list(watcher->queue);
+
+      rescan_list(watcher);
+
+      if (watcher->recursive && (watcher->backend != WATCHER_BACKEND_FANOTIFY))
+        attach_list(watcher);
+
+      if (watcher->backend == WATCHER_BACKEND_INOTIFY)
+        polling_list(watcher);
+
+      if (watcher->jobs)
+        jobs_list(watcher->jobs);
+
+      if (watcher->workers)
+        workers_list(watcher->workers);
     }
+
+#ifdef OS_LINUX
+  monitor_inotify_list();
+#endif
 }
 
 void
@@ -947,9 +1535,13 @@ parse_command_line(gint argc, gchar *argv[])
   gboolean verbose = FALSE;
   gint show_version = 0;
   gchar *watcher_path = NULL;
+  gchar *watcher_backend = NULL;
   gboolean watcher_recursive = CONFIG_KEY_WATCHER_RECURSIVE_DEFAULT;
   gint watcher_maxdepth = CONFIG_KEY_WATCHER_MAXDEPTH_DEFAULT;
   gchar *watcher_event = NULL;
+  gint watcher_coalesce = CONFIG_KEY_WATCHER_COALESCE_DEFAULT;
+  gint watcher_queuesize = CONFIG_KEY_WATCHER_QUEUESIZE_DEFAULT;
+  gchar *watcher_queuepolicy = NULL;
   gboolean watcher_mount = CONFIG_KEY_WATCHER_MOUNT_DEFAULT;
   gboolean watcher_readable = CONFIG_KEY_WATCHER_READABLE_DEFAULT;
   gboolean watcher_writable = CONFIG_KEY_WATCHER_WRITABLE_DEFAULT;
@@ -960,7 +1552,19 @@ parse_command_line(gint argc, gchar *argv[])
   gchar *watcher_group = NULL;
   gchar *watcher_include = NULL;
   gchar *watcher_exclude = NULL;
+  gchar *watcher_include_regex = NULL;
+  gchar *watcher_exclude_regex = NULL;
+  gchar *watcher_filter = NULL;
+  gchar *watcher_prune = NULL;
   gchar *watcher_exec = NULL;
+  gchar *watcher_execmode = NULL;
+  gint watcher_execworkers = CONFIG_KEY_WATCHER_EXECWORKERS_DEFAULT;
+  gchar *watcher_execframing = NULL;
+  gint watcher_maxjobs = CONFIG_KEY_WATCHER_MAXJOBS_DEFAULT;
+  gint watcher_jobtimeout = CONFIG_KEY_WATCHER_JOBTIMEOUT_DEFAULT;
+  gint watcher_execbatch = CONFIG_KEY_WATCHER_EXECBATCH_DEFAULT;
+  gint watcher_execbatchdelay = CONFIG_KEY_WATCHER_EXECBATCHDELAY_DEFAULT;
+  gboolean watcher_execbatch0 = CONFIG_KEY_WATCHER_EXECBATCH0_DEFAULT;
   gboolean watcher_print = FALSE;
   gboolean watcher_print0 = FALSE;
 
@@ -977,12 +1581,21 @@ parse_command_line(gint argc, gchar *argv[])
     {
       { "path", 0, 0, G_OPTION_ARG_FILENAME, &watcher_path,
           N_("Path to watch for events"), N_("PATH") },
+      { "backend", 0, 0, G_OPTION_ARG_STRING, &watcher_backend,
+          N_("Monitoring backend"), N_("BACKEND") },
       { "recursive", 0, 0, G_OPTION_ARG_NONE, &watcher_recursive,
           N_("Enable recursive mode"), NULL },
       { "maxdepth", 0, 0, G_OPTION_ARG_INT, &watcher_maxdepth,
           N_("Maximum depth of recursion"), N_("LEVEL") },
       { "event", 0, 0, G_OPTION_ARG_STRING, &watcher_event,
           N_("Event to watch"), N_("EVENT") },
+      { "coalesce", 0, 0, G_OPTION_ARG_INT, &watcher_coalesce,
+          N_("Merge the events of a file until it is quiet for a delay"),
+          N_("MS") },
+      { "queuesize", 0, 0, G_OPTION_ARG_INT, &watcher_queuesize,
+          N_("Number of events waiting for dispatch"), N_("N") },
+      { "queuepolicy", 0, 0, G_OPTION_ARG_STRING, &watcher_queuepolicy,
+          N_("Policy when the event queue is full"), N_("POLICY") },
       { "mount", 0, 0, G_OPTION_ARG_NONE, &watcher_mount,
           N_("Don't descend directories on other filesystems"), NULL },
       { "readable", 0, 0, G_OPTION_ARG_NONE, &watcher_readable,
@@ -1003,8 +1616,34 @@ parse_command_line(gint argc, gchar *argv[])
           N_("Include files list"), N_("LIST") },
       { "exclude", 0, 0, G_OPTION_ARG_STRING, &watcher_exclude,
           N_("Exclude files list"), N_("LIST") },
+      { "includeregex", 0, 0, G_OPTION_ARG_STRING, &watcher_include_regex,
+          N_("Include files regular expressions"), N_("LIST") },
+      { "excluderegex", 0, 0, G_OPTION_ARG_STRING, &watcher_exclude_regex,
+          N_("Exclude files regular expressions"), N_("LIST") },
+      { "filter", 0, 0, G_OPTION_ARG_STRING, &watcher_filter,
+          N_("Filter expression"), N_("EXPR") },
+      { "prune", 0, 0, G_OPTION_ARG_STRING, &watcher_prune,
+          N_("Directories list not to descend"), N_("LIST") },
       { "exec", 0, 0, G_OPTION_ARG_STRING, &watcher_exec,
           N_("Execute command on event"), N_("COMMAND") },
+      { "execmode", 0, 0, G_OPTION_ARG_STRING, &watcher_execmode,
+          N_("Command execution mode"), N_("MODE") },
+      { "execworkers", 0, 0, G_OPTION_ARG_INT, &watcher_execworkers,
+          N_("Number of persistent command workers"), N_("N") },
+      { "execframing", 0, 0, G_OPTION_ARG_STRING, &watcher_execframing,
+          N_("Framing of the events sent to persistent workers"),
+          N_("FRAMING") },
+      { "maxjobs", 0, 0, G_OPTION_ARG_INT, &watcher_maxjobs,
+          N_("Maximum number of commands running at once"), N_("N") },
+      { "jobtimeout", 0, 0, G_OPTION_ARG_INT, &watcher_jobtimeout,
+          N_("Kill commands running longer than a delay"), N_("SECONDS") },
+      { "execbatch", 0, 0, G_OPTION_ARG_INT, &watcher_execbatch,
+          N_("Execute command once per batch of events given on its input"),
+          N_("N") },
+      { "execbatchdelay", 0, 0, G_OPTION_ARG_INT, &watcher_execbatchdelay,
+          N_("Maximum delay before executing a batch"), N_("MS") },
+      { "execbatch0", 0, 0, G_OPTION_ARG_NONE, &watcher_execbatch0,
+          N_("Separate batched events with a null character"), NULL },
       { "print", 0, 0, G_OPTION_ARG_NONE, &watcher_print,
           N_("Print filename on event, followed by a newline") },
       { "print0", 0, 0, G_OPTION_ARG_NONE, &watcher_print0,
@@ -1053,6 +1692,11 @@ parse_command_line(gint argc, gchar *argv[])
 
       g_key_file_set_string(app->settings, CONFIG_GROUP_WATCHER,
           CONFIG_KEY_WATCHER_PATH, watcher_path);
+
+      if (watcher_backend)
+        g_key_file_set_string(app->settings, CONFIG_GROUP_WATCHER,
+            CONFIG_KEY_WATCHER_BACKEND, watcher_backend);
+
       g_key_file_set_boolean(app->settings, CONFIG_GROUP_WATCHER,
           CONFIG_KEY_WATCHER_RECURSIVE, watcher_recursive);
       g_key_file_set_integer(app->settings, CONFIG_GROUP_WATCHER,
@@ -1062,6 +1706,15 @@ parse_command_line(gint argc, gchar *argv[])
         g_key_file_set_string(app->settings, CONFIG_GROUP_WATCHER,
             CONFIG_KEY_WATCHER_EVENTS, watcher_event);
 
+      g_key_file_set_integer(app->settings, CONFIG_GROUP_WATCHER,
+          CONFIG_KEY_WATCHER_COALESCE, watcher_coalesce);
+      g_key_file_set_integer(app->settings, CONFIG_GROUP_WATCHER,
+          CONFIG_KEY_WATCHER_QUEUESIZE, watcher_queuesize);
+
+      if (watcher_queuepolicy)
+        g_key_file_set_string(app->settings, CONFIG_GROUP_WATCHER,
+            CONFIG_KEY_WATCHER_QUEUEPOLICY, watcher_queuepolicy);
+
       g_key_file_set_boolean(app->settings, CONFIG_GROUP_WATCHER,
           CONFIG_KEY_WATCHER_MOUNT, watcher_mount);
 
@@ -1098,10 +1751,53 @@ parse_command_line(gint argc, gchar *argv[])
         g_key_file_set_string(app->settings, CONFIG_GROUP_WATCHER,
             CONFIG_KEY_WATCHER_EXCLUDE, watcher_exclude);
 
+      if (watcher_include_regex)
+        g_key_file_set_value(app->settings, CONFIG_GROUP_WATCHER,
+            CONFIG_KEY_WATCHER_INCLUDEREGEX, watcher_include_regex);
+
+      if (watcher_exclude_regex)
+        g_key_file_set_value(app->settings, CONFIG_GROUP_WATCHER,
+            CONFIG_KEY_WATCHER_EXCLUDEREGEX, watcher_exclude_regex);
+
+      if (watcher_filter)
+        g_key_file_set_value(app->settings, CONFIG_GROUP_WATCHER,
+            CONFIG_KEY_WATCHER_FILTER, watcher_filter);
+
+      if (watcher_prune)
+        g_key_file_set_string(app->settings, CONFIG_GROUP_WATCHER,
+            CONFIG_KEY_WATCHER_PRUNE, watcher_prune);
+
       if (watcher_exec)
         g_key_file_set_string(app->settings, CONFIG_GROUP_WATCHER,
             CONFIG_KEY_WATCHER_EXEC, watcher_exec);
 
+      if (watcher_execmode)
+        g_key_file_set_string(app->settings, CONFIG_GROUP_WATCHER,
+            CONFIG_KEY_WATCHER_EXECMODE, watcher_execmode);
+
+      g_key_file_set_integer(app->settings, CONFIG_GROUP_WATCHER,
+          CONFIG_KEY_WATCHER_EXECWORKERS, watcher_execworkers);
+
+      if (watcher_execframing)
+        g_key_file_set_string(app->settings, CONFIG_GROUP_WATCHER,
+            CONFIG_KEY_WATCHER_EXECFRAMING, watcher_execframing);
+
+      g_key_file_set_integer(app->settings, CONFIG_GROUP_WATCHER,
+          CONFIG_KEY_WATCHER_MAXJOBS, watcher_maxjobs);
+      g_key_file_set_integer(app->settings, CONFIG_GROUP_WATCHER,
+          CONFIG_KEY_WATCHER_JOBTIMEOUT, watcher_jobtimeout);
+
+      if (watcher_execbatch > 0)
+        {
+          g_key_file_set_integer(app->settings, CONFIG_GROUP_WATCHER,
+              CONFIG_KEY_WATCHER_EXECBATCH, watcher_execbatch);
+          g_key_file_set_integer(app->settings, CONFIG_GROUP_WATCHER,
+              CONFIG_KEY_WATCHER_EXECBATCHDELAY, watcher_execbatchdelay);
+        }
+
+      g_key_file_set_boolean(app->settings, CONFIG_GROUP_WATCHER,
+          CONFIG_KEY_WATCHER_EXECBATCH0, watcher_execbatch0);
+
       g_key_file_set_boolean(app->settings, CONFIG_GROUP_WATCHER,
           CONFIG_KEY_WATCHER_PRINT, watcher_print);
 
@@ -1145,6 +1841,7 @@ sighup(gint sig)
 {
   LOG_INFO("%s", N_("SIGHUP received, reloading configuration"));
 
+  identity_invalidate();
   reload_config();
 }
 
@@ -1238,20 +1935,8 @@ cleanup(void)
       for (item = app->watchers; item; item = item->next)
         {
           watcher = (watcher_t *) item->data;
-          if (!watcher)
-            continue;
 
-          g_free(watcher->name);
-          g_free(watcher->path);
-          g_free(watcher->exec);
-          g_free(watcher->type);
-          g_free(watcher->user);
-          g_free(watcher->group);
-          g_strfreev(watcher->events);
-          g_strfreev(watcher->includes);
-          g_strfreev(watcher->excludes);
-          g_hash_table_destroy(watcher->monitors);
-          g_free(watcher);
+          watcher_free(watcher);
         }
 
       g_slist_free(app->watchers);
@@ -1275,9 +1960,9 @@ main(gint argc, gchar *argv[])
   bindtextdomain(PACKAGE, LOCALEDIR);
   textdomain(PACKAGE);
 
-  if (glib_check_version(2, 6, 0))
+  if (glib_check_version(2, 32, 0))
     {
-      g_error(N_("GLib version 2.6.0 or above is needed"));
+      g_error(N_("GLib version 2.32.0 or above is needed"));
     }
 
 #ifdef DEBUG
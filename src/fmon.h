@@ -55,9 +55,23 @@
 #define CONFIG_KEY_MAIN_USESYSLOG_DEFAULT               CONFIG_KEY_MAIN_USESYSLOG_NO
 #define CONFIG_KEY_MAIN_SYSLOGFACILITY                  "SyslogFacility"
 #define CONFIG_KEY_MAIN_SYSLOGFACILITY_DEFAULT          "DAEMON";
+#define CONFIG_KEY_MAIN_CRAWLERTHREADS                  "CrawlerThreads"
+#define CONFIG_KEY_MAIN_CRAWLERTHREADS_DEFAULT          0
+#define CONFIG_KEY_MAIN_READYFILE                       "ReadyFile"
+#define CONFIG_KEY_MAIN_MAXWATCHES                      "MaxWatches"
+#define CONFIG_KEY_MAIN_MAXWATCHES_DEFAULT              0
 
 #define CONFIG_GROUP_WATCHER                            "watcher"
 #define CONFIG_KEY_WATCHER_PATH                         "Path"
+#define CONFIG_KEY_WATCHER_BACKEND                      "Backend"
+#define CONFIG_KEY_WATCHER_BACKEND_GIO                  "gio"
+#define CONFIG_KEY_WATCHER_BACKEND_INOTIFY              "inotify"
+#define CONFIG_KEY_WATCHER_BACKEND_FANOTIFY             "fanotify"
+#ifdef OS_LINUX
+#define CONFIG_KEY_WATCHER_BACKEND_DEFAULT              CONFIG_KEY_WATCHER_BACKEND_INOTIFY
+#else
+#define CONFIG_KEY_WATCHER_BACKEND_DEFAULT              CONFIG_KEY_WATCHER_BACKEND_GIO
+#endif
 #define CONFIG_KEY_WATCHER_RECURSIVE                    "Recursive"
 #define CONFIG_KEY_WATCHER_RECURSIVE_DEFAULT            0
 #define CONFIG_KEY_WATCHER_MAXDEPTH                     "MaxDepth"
@@ -70,6 +84,19 @@
 #define CONFIG_KEY_WATCHER_EVENT_ATTRIBUTECHANGED       "attribute_changed"
 #define CONFIG_KEY_WATCHER_EVENT_MOUNTED                "mounted"
 #define CONFIG_KEY_WATCHER_EVENT_UNMOUNTED              "unmounted"
+#define CONFIG_KEY_WATCHER_COALESCE                     "Coalesce"
+#define CONFIG_KEY_WATCHER_COALESCE_DEFAULT             0
+#define CONFIG_KEY_WATCHER_QUEUESIZE                    "QueueSize"
+#define CONFIG_KEY_WATCHER_QUEUESIZE_DEFAULT            1024
+#define CONFIG_KEY_WATCHER_QUEUEPOLICY                  "QueuePolicy"
+#define CONFIG_KEY_WATCHER_QUEUEPOLICY_BLOCK            "block"
+#define CONFIG_KEY_WATCHER_QUEUEPOLICY_DROPOLDEST       "drop_oldest"
+#define CONFIG_KEY_WATCHER_QUEUEPOLICY_DROPNEWEST       "drop_newest"
+#define CONFIG_KEY_WATCHER_QUEUEPOLICY_RESCAN           "rescan"
+#define CONFIG_KEY_WATCHER_PRIORITY                     "Priority"
+#define CONFIG_KEY_WATCHER_PRIORITY_DEFAULT             0
+#define CONFIG_KEY_WATCHER_POLLINTERVAL                 "PollInterval"
+#define CONFIG_KEY_WATCHER_POLLINTERVAL_DEFAULT         60
 #define CONFIG_KEY_WATCHER_MOUNT                        "Mount"
 #define CONFIG_KEY_WATCHER_MOUNT_DEFAULT                0
 #define CONFIG_KEY_WATCHER_READABLE			"Readable"
@@ -95,14 +122,41 @@
 #define CONFIG_KEY_WATCHER_TYPE_SOCKET                  "s"
 #define CONFIG_KEY_WATCHER_USER                         "User"
 #define CONFIG_KEY_WATCHER_GROUP                        "Group"
+#define CONFIG_KEY_WATCHER_IDENTITYTTL                  "IdentityTTL"
+#define CONFIG_KEY_WATCHER_IDENTITYTTL_DEFAULT          300
 #define CONFIG_KEY_WATCHER_INCLUDE                      "Include"
 #define CONFIG_KEY_WATCHER_EXCLUDE                      "Exclude"
+#define CONFIG_KEY_WATCHER_INCLUDEREGEX                 "IncludeRegex"
+#define CONFIG_KEY_WATCHER_EXCLUDEREGEX                 "ExcludeRegex"
+#define CONFIG_KEY_WATCHER_FILTER                       "Filter"
+#define CONFIG_KEY_WATCHER_PRUNE                        "Prune"
 #define CONFIG_KEY_WATCHER_EXEC                         "Exec"
 #define CONFIG_KEY_WATCHER_EXEC_KEY_NAME                "$name"
 #define CONFIG_KEY_WATCHER_EXEC_KEY_PATH                "$path"
 #define CONFIG_KEY_WATCHER_EXEC_KEY_EVENT               "$event"
 #define CONFIG_KEY_WATCHER_EXEC_KEY_FILE                "$file"
 #define CONFIG_KEY_WATCHER_EXEC_KEY_RFILE               "$rfile"
+#define CONFIG_KEY_WATCHER_EXECMODE                     "ExecMode"
+#define CONFIG_KEY_WATCHER_EXECMODE_SPAWN               "spawn"
+#define CONFIG_KEY_WATCHER_EXECMODE_PERSISTENT          "persistent"
+#define CONFIG_KEY_WATCHER_EXECWORKERS                  "ExecWorkers"
+#define CONFIG_KEY_WATCHER_EXECWORKERS_DEFAULT          1
+#define CONFIG_KEY_WATCHER_EXECFRAMING                  "ExecFraming"
+#define CONFIG_KEY_WATCHER_EXECFRAMING_NEWLINE          "newline"
+#define CONFIG_KEY_WATCHER_EXECFRAMING_NULL             "null"
+#define CONFIG_KEY_WATCHER_EXECFRAMING_LENGTH           "length"
+#define CONFIG_KEY_WATCHER_EXECBACKLOG                  "ExecBacklog"
+#define CONFIG_KEY_WATCHER_EXECBACKLOG_DEFAULT          16
+#define CONFIG_KEY_WATCHER_MAXJOBS                      "MaxJobs"
+#define CONFIG_KEY_WATCHER_MAXJOBS_DEFAULT              0
+#define CONFIG_KEY_WATCHER_JOBTIMEOUT                   "JobTimeout"
+#define CONFIG_KEY_WATCHER_JOBTIMEOUT_DEFAULT           0
+#define CONFIG_KEY_WATCHER_EXECBATCH                    "ExecBatch"
+#define CONFIG_KEY_WATCHER_EXECBATCH_DEFAULT            0
+#define CONFIG_KEY_WATCHER_EXECBATCHDELAY               "ExecBatchDelay"
+#define CONFIG_KEY_WATCHER_EXECBATCHDELAY_DEFAULT       1000
+#define CONFIG_KEY_WATCHER_EXECBATCH0                   "ExecBatch0"
+#define CONFIG_KEY_WATCHER_EXECBATCH0_DEFAULT           0
 #define CONFIG_KEY_WATCHER_PRINT                        "Print"
 #define CONFIG_KEY_WATCHER_PRINT0                       "Print0"
 
@@ -114,8 +168,11 @@ typedef struct _application_t
   GKeyFile *settings;
   GUnixMountMonitor *mount;
   GList *mounts;
+  struct _monitor_inotify_t *inotify;
   GSList *watchers;
   gboolean started;
+  guint crawler_threads;
+  guint crawling;
   gchar *config_file;
   gboolean verbose;
 } application_t;
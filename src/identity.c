@@ -0,0 +1,211 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "fmon.h"
+#include "identity.h"
+
+#include <sys/types.h>
+#include <errno.h>
+#include <grp.h>
+#include <pwd.h>
+#include <stdlib.h>
+#include <string.h>
+
+static volatile guint identity_generation = 1;
+
+static gboolean
+identity_parse_id(const gchar *str, guint32 *id)
+{
+  gchar *err;
+  guint64 value;
+
+  if (!g_ascii_isdigit(*str))
+    return FALSE;
+
+  errno = 0;
+  value = g_ascii_strtoull(str, &err, 10);
+  if ((*err != '\0') || (errno != 0) || (value > G_MAXUINT32))
+    return FALSE;
+
+  *id = (guint32) value;
+
+  return TRUE;
+}
+
+static void
+identity_resolve(identity_t *identity)
+{
+  identity_entry_t *entry;
+  guint i;
+
+  for (i = 0; i < identity->n_entries; i++)
+    {
+      entry = &identity->entries[i];
+      if (!entry->name)
+        continue;
+
+      entry->resolved = FALSE;
+
+      if (identity->kind == IDENTITY_KIND_USER)
+        {
+          struct passwd *pwd;
+
+          pwd = getpwnam(entry->name);
+          if (pwd)
+            {
+              entry->first = entry->last = pwd->pw_uid;
+              entry->resolved = TRUE;
+            }
+        }
+      else
+        {
+          struct group *grp;
+
+          grp = getgrnam(entry->name);
+          if (grp)
+            {
+              entry->first = entry->last = grp->gr_gid;
+              entry->resolved = TRUE;
+            }
+        }
+
+      if (!entry->resolved)
+        {
+          LOG_ERROR("%s '%s'", identity->kind == IDENTITY_KIND_USER
+              ? N_("failed to retrieve the user name")
+              : N_("failed to retrieve the group name"), entry->name);
+        }
+    }
+
+  identity->generation = identity_generation;
+  identity->expires = identity->ttl
+      ? g_get_monotonic_time() + (gint64) identity->ttl * G_USEC_PER_SEC : 0;
+}
+
+identity_t *
+identity_new(guint kind, const gchar *spec, guint ttl)
+{
+  identity_t *identity;
+  identity_entry_t *entry;
+  gchar **tokens, *token, *sep;
+  guint i;
+
+  tokens = g_strsplit(spec, ",", -1);
+
+  identity = g_new0(identity_t, 1);
+  identity->kind = kind;
+  identity->ttl = ttl;
+  identity->entries = g_new0(identity_entry_t, g_strv_length(tokens));
+
+  for (i = 0; tokens[i] != NULL; i++)
+    {
+      token = g_strstrip(tokens[i]);
+      if (*token == '\0')
+        continue;
+
+      entry = &identity->entries[identity->n_entries++];
+
+      if (identity_parse_id(token, &entry->first))
+        {
+          entry->last = entry->first;
+          entry->resolved = TRUE;
+
+          continue;
+        }
+
+      sep = strchr(token, '-');
+      if (sep)
+        {
+          *sep = '\0';
+
+          if (identity_parse_id(token, &entry->first)
+              && identity_parse_id(sep + 1, &entry->last)
+              && (entry->first <= entry->last))
+            {
+              entry->resolved = TRUE;
+
+              continue;
+            }
+
+          *sep = '-';
+        }
+
+      entry->name = g_strdup(token);
+    }
+
+  g_strfreev(tokens);
+
+  if (identity->n_entries == 0)
+    {
+      identity_free(identity);
+
+      return NULL;
+    }
+
+  identity_resolve(identity);
+
+  return identity;
+}
+
+void
+identity_free(identity_t *identity)
+{
+  guint i;
+
+  if (!identity)
+    return;
+
+  for (i = 0; i < identity->n_entries; i++)
+    g_free(identity->entries[i].name);
+
+  g_free(identity->entries);
+  g_free(identity);
+}
+
+gboolean
+identity_match(identity_t *identity, guint32 id)
+{
+  identity_entry_t *entry;
+  guint i;
+
+  if ((identity->generation != identity_generation)
+      || (identity->expires && (g_get_monotonic_time() >= identity->expires)))
+    identity_resolve(identity);
+
+  for (i = 0; i < identity->n_entries; i++)
+    {
+      entry = &identity->entries[i];
+
+      if (entry->resolved && (id >= entry->first) && (id <= entry->last))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/*
+ * Invalidates the resolved names of all identities, which are resolved
+ * again on their next match. Safe to call from a signal handler.
+ */
+void
+identity_invalidate(void)
+{
+  identity_generation++;
+}
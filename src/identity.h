@@ -0,0 +1,55 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef IDENTITY_H_
+#define IDENTITY_H_
+
+#include "common.h"
+
+typedef struct _identity_entry_t
+{
+  gchar *name;
+  guint32 first;
+  guint32 last;
+  gboolean resolved;
+} identity_entry_t;
+
+typedef struct _identity_t
+{
+  guint kind;
+#define IDENTITY_KIND_USER              0
+#define IDENTITY_KIND_GROUP             1
+  identity_entry_t *entries;
+  guint n_entries;
+  guint ttl;
+  gint64 expires;
+  guint generation;
+} identity_t;
+
+identity_t *
+identity_new(guint kind, const gchar *spec, guint ttl);
+void
+identity_free(identity_t *identity);
+gboolean
+identity_match(identity_t *identity, guint32 id);
+void
+identity_invalidate(void);
+
+#endif /* IDENTITY_H_ */
@@ -0,0 +1,527 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "fmon.h"
+#include "jobs.h"
+#include "watcher.h"
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+
+extern char **environ;
+
+typedef struct _job_input_t
+{
+  gchar *name;
+  GString *records;
+  gsize offset;
+  gint fd;
+} job_input_t;
+
+static void
+jobs_schedule(jobs_t *jobs);
+static void
+jobs_destroy(jobs_t *jobs);
+
+static void
+job_free(job_t *job)
+{
+  g_free(job->key);
+  g_strfreev(job->argv);
+  if (job->input)
+    g_string_free(job->input, TRUE);
+
+  g_free(job);
+}
+
+static void
+jobs_key_free(gpointer data)
+{
+  GQueue *waiting;
+  job_t *job;
+
+  waiting = (GQueue *) data;
+
+  while ((job = (job_t *) g_queue_pop_head(waiting)) != NULL)
+    job_free(job);
+
+  g_queue_free(waiting);
+}
+
+static void
+jobs_release(jobs_t *jobs, job_t *job)
+{
+  GQueue *waiting;
+
+  if (!job->key)
+    return;
+
+  /* the next command on the same key may run now */
+  waiting = (GQueue *) g_hash_table_lookup(jobs->keys, job->key);
+  if (waiting && !g_queue_is_empty(waiting))
+    {
+      g_queue_push_tail(&jobs->pending, g_queue_pop_head(waiting));
+
+      return;
+    }
+
+  g_hash_table_remove(jobs->keys, job->key);
+}
+
+static gboolean
+jobs_input_write(GIOChannel *channel, GIOCondition condition,
+    gpointer user_data)
+{
+  job_input_t *input;
+  gssize len;
+
+  input = (job_input_t *) user_data;
+
+  while (input->offset < input->records->len)
+    {
+      len = write(input->fd, input->records->str + input->offset,
+          input->records->len - input->offset);
+      if (len < 0)
+        {
+          if (errno == EINTR)
+            continue;
+
+          if (errno == EAGAIN)
+            return TRUE;
+
+          LOG_ERROR("%s: %s (%s)",
+              input->name, N_("failed to write events to command"),
+              g_strerror(errno));
+
+          break;
+        }
+
+      input->offset += len;
+    }
+
+  /* closing the pipe signals the end of the input to the command */
+  close(input->fd);
+  g_string_free(input->records, TRUE);
+  g_free(input->name);
+  g_free(input);
+
+  return FALSE;
+}
+
+static void
+jobs_child_exited(GPid pid, gint status, gpointer user_data)
+{
+  job_t *job;
+  jobs_t *jobs;
+  gint64 latency;
+
+  job = (job_t *) user_data;
+  jobs = job->jobs;
+
+  g_spawn_close_pid(pid);
+
+  if (job->timeout_source)
+    g_source_remove(job->timeout_source);
+
+  /* the watcher may have been stopped while the command was running */
+  if (!jobs)
+    {
+      job_free(job);
+
+      return;
+    }
+
+  latency = g_get_monotonic_time() - job->started;
+
+  if (WIFEXITED(status) && (WEXITSTATUS(status) == 0))
+    {
+      jobs->succeeded++;
+    }
+  else if (WIFEXITED(status))
+    {
+      jobs->failed++;
+
+      LOG_INFO("%s: %s (pid=%d, status=%d)",
+          jobs->watcher->name, N_("command failed"), pid, WEXITSTATUS(status));
+    }
+  else
+    {
+      jobs->killed++;
+
+      LOG_INFO("%s: %s (pid=%d, signal=%d)",
+          jobs->watcher->name, N_("command killed"), pid,
+          WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+    }
+
+  jobs->latency_total += latency;
+  if (latency > jobs->latency_max)
+    jobs->latency_max = latency;
+
+  LOG_DEBUG("%s: %s (pid=%d, time=%" G_GINT64_FORMAT "ms)",
+      jobs->watcher->name, N_("command exited"), pid, latency / 1000);
+
+  g_queue_unlink(&jobs->running, &job->link);
+  jobs_release(jobs, job);
+  job_free(job);
+
+  jobs_schedule(jobs);
+
+  /* a stopped watcher frees its commands once the last one exits */
+  if (jobs->stopping && g_queue_is_empty(&jobs->running))
+    {
+      LOG_INFO("%s: %s", jobs->watcher->name, N_("pending commands drained"));
+
+      jobs_list(jobs);
+      jobs_destroy(jobs);
+    }
+}
+
+static gboolean
+jobs_child_timeout(gpointer user_data)
+{
+  job_t *job;
+
+  job = (job_t *) user_data;
+  job->timeout_source = 0;
+
+  if (job->jobs)
+    LOG_ERROR("%s: %s (pid=%d)",
+        job->jobs->watcher->name, N_("command timed out"), job->pid);
+
+  /* the command runs in its own process group with its children */
+  kill(-job->pid, SIGKILL);
+
+  return FALSE;
+}
+
+static gboolean
+jobs_spawn(jobs_t *jobs, job_t *job)
+{
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  job_input_t *input;
+  GIOChannel *channel;
+  sigset_t mask;
+  gint fds[2] = { -1, -1 };
+  gint ret;
+  pid_t pid;
+
+  if (job->input)
+    {
+      if (pipe(fds) < 0)
+        {
+          LOG_ERROR("%s: %s (%s)",
+              jobs->watcher->name, N_("failed to execute command"),
+              g_strerror(errno));
+
+          return FALSE;
+        }
+
+      fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+      fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    }
+
+  posix_spawn_file_actions_init(&actions);
+  if (job->input)
+    posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setpgroup(&attr, 0);
+
+  sigemptyset(&mask);
+  posix_spawnattr_setsigmask(&attr, &mask);
+
+  /* the signals ignored by the daemon must not be ignored by the command */
+  sigaddset(&mask, SIGHUP);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  sigaddset(&mask, SIGPIPE);
+  sigaddset(&mask, SIGUSR1);
+  sigaddset(&mask, SIGUSR2);
+  posix_spawnattr_setsigdefault(&attr, &mask);
+
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP
+      | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF
+#ifdef POSIX_SPAWN_USEVFORK
+      | POSIX_SPAWN_USEVFORK
+#endif
+      );
+
+  ret = posix_spawnp(&pid, job->argv[0], &actions, &attr, job->argv, environ);
+
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+
+  if (job->input)
+    close(fds[0]);
+
+  if (ret != 0)
+    {
+      LOG_ERROR("%s: %s (%s)",
+          jobs->watcher->name, N_("failed to execute command"),
+          g_strerror(ret));
+
+      if (job->input)
+        close(fds[1]);
+
+      jobs->errors++;
+
+      return FALSE;
+    }
+
+  job->pid = pid;
+  job->started = g_get_monotonic_time();
+
+  jobs->started++;
+  jobs->wait_total += job->started - job->queued;
+
+  g_queue_push_tail_link(&jobs->running, &job->link);
+
+  g_child_watch_add(pid, jobs_child_exited, job);
+
+  if (jobs->timeout > 0)
+    job->timeout_source = g_timeout_add_seconds(jobs->timeout,
+        jobs_child_timeout, job);
+
+  LOG_DEBUG("%s: %s (pid=%d)",
+      jobs->watcher->name, N_("command started"), pid);
+
+  if (job->input)
+    {
+      /* the input is written as the command reads it to not block the main
+       * loop on a slow command */
+      fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+
+      input = g_new0(job_input_t, 1);
+      input->name = g_strdup(jobs->watcher->name);
+      input->records = job->input;
+      input->fd = fds[1];
+
+      job->input = NULL;
+
+      if (jobs_input_write(NULL, G_IO_OUT, input))
+        {
+          channel = g_io_channel_unix_new(input->fd);
+          g_io_add_watch(channel, G_IO_OUT | G_IO_ERR | G_IO_HUP,
+              jobs_input_write, input);
+          g_io_channel_unref(channel);
+        }
+    }
+
+  return TRUE;
+}
+
+static void
+jobs_schedule(jobs_t *jobs)
+{
+  job_t *job;
+
+  while (!g_queue_is_empty(&jobs->pending)
+      && ((jobs->max_jobs == 0) || (jobs->running.length < jobs->max_jobs)))
+    {
+      job = (job_t *) g_queue_pop_head(&jobs->pending);
+
+      if (!jobs_spawn(jobs, job))
+        {
+          jobs_release(jobs, job);
+          job_free(job);
+        }
+    }
+}
+
+jobs_t *
+jobs_new(watcher_t *watcher, guint max_jobs, guint timeout)
+{
+  jobs_t *jobs;
+
+  jobs = g_new0(jobs_t, 1);
+  jobs->watcher = watcher;
+  jobs->max_jobs = max_jobs;
+  jobs->timeout = timeout;
+  g_queue_init(&jobs->pending);
+  g_queue_init(&jobs->running);
+  jobs->keys = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+      jobs_key_free);
+
+  return jobs;
+}
+
+static void
+jobs_destroy(jobs_t *jobs)
+{
+  GList *link;
+  job_t *job;
+
+  while ((job = (job_t *) g_queue_pop_head(&jobs->pending)) != NULL)
+    job_free(job);
+
+  g_hash_table_destroy(jobs->keys);
+
+  /* the running commands are reaped without accounting */
+  while ((link = g_queue_pop_head_link(&jobs->running)) != NULL)
+    ((job_t *) link->data)->jobs = NULL;
+
+  g_free(jobs);
+}
+
+static void
+jobs_drop(jobs_t *jobs, GQueue *queue)
+{
+  GList *item;
+  job_t *job;
+  gsize i;
+  guint records;
+  gchar delimiter;
+
+  delimiter = jobs->watcher->exec_batch0 ? '\0' : '\n';
+
+  /* the events of a batch are lost with its command */
+  for (item = queue->head; item; item = item->next)
+    {
+      job = (job_t *) item->data;
+      if (!job->input)
+        continue;
+
+      records = 0;
+      for (i = 0; i < job->input->len; i++)
+        {
+          if (job->input->str[i] == delimiter)
+            records++;
+        }
+
+      LOG_ERROR("%s: %s (events=%u)",
+          jobs->watcher->name, N_("dropping batch of events"), records);
+    }
+
+  jobs->dropped += queue->length;
+}
+
+void
+jobs_free(jobs_t *jobs)
+{
+  GHashTableIter iter;
+  gpointer value;
+  guint count;
+
+  if (!jobs)
+    return;
+
+  count = g_queue_get_length(&jobs->pending);
+
+  g_hash_table_iter_init(&iter, jobs->keys);
+  while (g_hash_table_iter_next(&iter, NULL, &value))
+    count += g_queue_get_length((GQueue *) value);
+
+  /* a command waits only behind a running one, so the accepted commands
+   * keep starting in order and within the limit while the main loop runs */
+  if ((count > 0) && app->loop && g_main_loop_is_running(app->loop))
+    {
+      LOG_INFO("%s: %s (%u)",
+          jobs->watcher->name, N_("draining pending commands"), count);
+
+      jobs->stopping = TRUE;
+
+      return;
+    }
+
+  if (count > 0)
+    {
+      LOG_ERROR("%s: %s (%u)",
+          jobs->watcher->name, N_("dropping pending commands"), count);
+
+      jobs_drop(jobs, &jobs->pending);
+
+      g_hash_table_iter_init(&iter, jobs->keys);
+      while (g_hash_table_iter_next(&iter, NULL, &value))
+        jobs_drop(jobs, (GQueue *) value);
+    }
+
+  jobs_list(jobs);
+  jobs_destroy(jobs);
+}
+
+void
+jobs_run(jobs_t *jobs, const gchar *key, gchar **argv, GString *input)
+{
+  GQueue *waiting;
+  job_t *job;
+
+  job = g_new0(job_t, 1);
+  job->jobs = jobs;
+  job->key = g_strdup(key);
+  job->argv = argv;
+  job->input = input;
+  job->queued = g_get_monotonic_time();
+  job->link.data = job;
+
+  /* the commands on a key run one at a time in order, the commands on
+   * different keys run in parallel */
+  if (key)
+    {
+      waiting = (GQueue *) g_hash_table_lookup(jobs->keys, key);
+      if (waiting)
+        {
+          g_queue_push_tail(waiting, job);
+
+          LOG_DEBUG("%s: %s (key=%s)",
+              jobs->watcher->name, N_("command waiting for previous one"),
+              key);
+
+          return;
+        }
+
+      g_hash_table_insert(jobs->keys, g_strdup(key), g_queue_new());
+    }
+
+  g_queue_push_tail(&jobs->pending, job);
+
+  if ((jobs->max_jobs > 0) && (jobs->running.length >= jobs->max_jobs))
+    LOG_DEBUG("%s: %s (pending=%d)",
+        jobs->watcher->name, N_("command queued"),
+        g_queue_get_length(&jobs->pending));
+
+  jobs_schedule(jobs);
+}
+
+void
+jobs_list(const jobs_t *jobs)
+{
+  guint64 done;
+
+  done = jobs->succeeded + jobs->failed + jobs->killed;
+
+  LOG_INFO("%s: %s (running=%d, pending=%d, started=%" G_GUINT64_FORMAT
+      ", succeeded=%" G_GUINT64_FORMAT ", failed=%" G_GUINT64_FORMAT
+      ", killed=%" G_GUINT64_FORMAT ", errors=%" G_GUINT64_FORMAT
+      ", dropped=%" G_GUINT64_FORMAT ", wait=%" G_GINT64_FORMAT
+      "ms, time=%" G_GINT64_FORMAT "ms, max=%" G_GINT64_FORMAT "ms)",
+      jobs->watcher->name, N_("commands"),
+      jobs->running.length, jobs->pending.length, jobs->started,
+      jobs->succeeded, jobs->failed, jobs->killed, jobs->errors,
+      jobs->dropped,
+      jobs->started ? jobs->wait_total / (gint64) jobs->started / 1000 : 0,
+      done ? jobs->latency_total / (gint64) done / 1000 : 0,
+      jobs->latency_max / 1000);
+}
@@ -0,0 +1,70 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef JOBS_H_
+#define JOBS_H_
+
+#include "common.h"
+
+struct _watcher_t;
+
+typedef struct _job_t
+{
+  struct _jobs_t *jobs;
+  gchar *key;
+  gchar **argv;
+  GString *input;
+  GPid pid;
+  gint64 queued;
+  gint64 started;
+  guint timeout_source;
+  GList link;
+} job_t;
+
+typedef struct _jobs_t
+{
+  struct _watcher_t *watcher;
+  guint max_jobs;
+  guint timeout;
+  GQueue pending;
+  GQueue running;
+  GHashTable *keys;
+  gboolean stopping;
+  guint64 started;
+  guint64 succeeded;
+  guint64 failed;
+  guint64 killed;
+  guint64 errors;
+  guint64 dropped;
+  gint64 wait_total;
+  gint64 latency_total;
+  gint64 latency_max;
+} jobs_t;
+
+jobs_t *
+jobs_new(struct _watcher_t *watcher, guint max_jobs, guint timeout);
+void
+jobs_free(jobs_t *jobs);
+void
+jobs_run(jobs_t *jobs, const gchar *key, gchar **argv, GString *input);
+void
+jobs_list(const jobs_t *jobs);
+
+#endif /* JOBS_H_ */
@@ -0,0 +1,351 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#define _GNU_SOURCE
+
+#include "fmon.h"
+#include "monitor_fanotify.h"
+#include "rescan.h"
+#include "statcache.h"
+#include "watcher.h"
+
+#ifdef MONITOR_FANOTIFY_SUPPORTED
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MONITOR_FANOTIFY_BUFFER         65536
+#define MONITOR_FANOTIFY_HANDLES_MAX    4096
+
+static const struct
+{
+  guint64 mask;
+  GFileMonitorEvent event_type;
+} monitor_fanotify_events[] =
+  {
+    { FAN_CREATE | FAN_MOVED_TO, G_FILE_MONITOR_EVENT_CREATED },
+    { FAN_MODIFY, G_FILE_MONITOR_EVENT_CHANGED },
+    { FAN_CLOSE_WRITE, G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT },
+    { FAN_ATTRIB, G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED },
+    { FAN_DELETE | FAN_MOVED_FROM, G_FILE_MONITOR_EVENT_DELETED } };
+
+static guint64
+monitor_fanotify_get_mask(const watcher_t *watcher)
+{
+  guint events;
+  guint64 mask;
+
+  /* directory renames and deletions keep the handle cache coherent */
+  mask = FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_ONDIR;
+
+  events = watcher_get_required_events(watcher);
+
+  if (events & WATCHER_EVENT_CREATED)
+    mask |= FAN_CREATE;
+
+  if (events & WATCHER_EVENT_CHANGED)
+    mask |= FAN_MODIFY;
+
+  if (events & WATCHER_EVENT_CHANGING)
+    mask |= FAN_CLOSE_WRITE;
+
+  if (events & WATCHER_EVENT_ATTRIBUTECHANGED)
+    mask |= FAN_ATTRIB;
+
+  return mask;
+}
+
+gboolean
+monitor_fanotify_create(watcher_t *watcher)
+{
+  monitor_fanotify_t *fanotify;
+  gint fd, mount_fd;
+
+  LOG_DEBUG("%s: %s (path=%s)",
+      watcher->name, N_("creating fanotify monitor for path"), watcher->path);
+
+  fd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK
+      | FAN_REPORT_DFID_NAME, O_RDONLY);
+  if (fd < 0)
+    {
+      LOG_ERROR("%s: %s (%s)",
+          watcher->name, N_("failed to create fanotify monitor"), g_strerror(errno));
+
+      return FALSE;
+    }
+
+  if (fanotify_mark(fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM,
+      monitor_fanotify_get_mask(watcher), AT_FDCWD, watcher->path) < 0)
+    {
+      LOG_ERROR("%s: %s (%s)",
+          watcher->name, N_("failed to add fanotify mark"), g_strerror(errno));
+
+      close(fd);
+
+      return FALSE;
+    }
+
+  mount_fd = open(watcher->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (mount_fd < 0)
+    {
+      LOG_ERROR("%s: %s (%s)",
+          watcher->name, N_("failed to open watcher path"), g_strerror(errno));
+
+      close(fd);
+
+      return FALSE;
+    }
+
+  fanotify = g_new0(monitor_fanotify_t, 1);
+  fanotify->fd = fd;
+  fanotify->mount_fd = mount_fd;
+  fanotify->watcher = watcher;
+  fanotify->handles = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+      g_free);
+  fanotify->channel = g_io_channel_unix_new(fd);
+  fanotify->source = g_io_add_watch(fanotify->channel, G_IO_IN,
+      monitor_fanotify_event, fanotify);
+
+  watcher->fanotify = fanotify;
+
+  return TRUE;
+}
+
+void
+monitor_fanotify_destroy(watcher_t *watcher)
+{
+  monitor_fanotify_t *fanotify;
+
+  fanotify = watcher->fanotify;
+  if (!fanotify)
+    return;
+
+  LOG_DEBUG("%s: %s", watcher->name, N_("destroying fanotify monitor"));
+
+  g_source_remove(fanotify->source);
+  g_io_channel_unref(fanotify->channel);
+  g_hash_table_destroy(fanotify->handles);
+  close(fanotify->mount_fd);
+  close(fanotify->fd);
+  g_free(fanotify);
+
+  watcher->fanotify = NULL;
+}
+
+static gchar *
+monitor_fanotify_resolve(monitor_fanotify_t *fanotify,
+    struct file_handle *handle)
+{
+  GString *key;
+  gchar *path, *link;
+  gint fd;
+  guint i;
+
+  key = g_string_sized_new(2 * handle->handle_bytes + 12);
+  g_string_append_printf(key, "%d:", handle->handle_type);
+  for (i = 0; i < handle->handle_bytes; i++)
+    g_string_append_printf(key, "%02x", handle->f_handle[i]);
+
+  path = g_hash_table_lookup(fanotify->handles, key->str);
+  if (path)
+    {
+      g_string_free(key, TRUE);
+
+      return g_strdup(path);
+    }
+
+  fd = open_by_handle_at(fanotify->mount_fd, handle, O_PATH);
+  if (fd < 0)
+    {
+      LOG_DEBUG("%s: %s (%s)",
+          fanotify->watcher->name, N_("failed to open file handle"), g_strerror(errno));
+
+      g_string_free(key, TRUE);
+
+      return NULL;
+    }
+
+  link = g_strdup_printf("/proc/self/fd/%d", fd);
+  path = g_file_read_link(link, NULL);
+  g_free(link);
+  close(fd);
+
+  if (!path)
+    {
+      g_string_free(key, TRUE);
+
+      return NULL;
+    }
+
+  if (g_hash_table_size(fanotify->handles) >= MONITOR_FANOTIFY_HANDLES_MAX)
+    g_hash_table_remove_all(fanotify->handles);
+
+  g_hash_table_insert(fanotify->handles, g_string_free(key, FALSE),
+      g_strdup(path));
+
+  return path;
+}
+
+static gboolean
+monitor_fanotify_is_pruned(watcher_t *watcher, const gchar *file)
+{
+  gchar *path, *ptr;
+  gboolean pruned = FALSE;
+
+  /* the mark covers the whole filesystem, so check every ancestor */
+  path = g_strdup(file);
+
+  while (!pruned && (ptr = strrchr(path, G_DIR_SEPARATOR)) && (ptr != path))
+    {
+      *ptr = '\0';
+
+      if (!watcher_get_relative_path(watcher, path))
+        break;
+
+      pruned = watcher_is_pruned(watcher, path);
+    }
+
+  g_free(path);
+
+  return pruned;
+}
+
+gboolean
+monitor_fanotify_event(GIOChannel *channel, GIOCondition condition,
+    gpointer user_data)
+{
+  monitor_fanotify_t *fanotify;
+  struct fanotify_event_metadata *metadata;
+  struct fanotify_event_info_fid *info;
+  struct file_handle *handle;
+  watcher_t *watcher;
+  gchar buffer[MONITOR_FANOTIFY_BUFFER]
+      __attribute__ ((aligned(__alignof__(struct fanotify_event_metadata))));
+  const gchar *name, *rfile;
+  gchar *dir, *file;
+  gssize len;
+  guint depth, i;
+
+  fanotify = (monitor_fanotify_t *) user_data;
+  watcher = fanotify->watcher;
+
+  while ((len = read(fanotify->fd, buffer, sizeof(buffer))) > 0)
+    {
+      statcache_begin();
+
+      for (metadata = (struct fanotify_event_metadata *) buffer;
+          FAN_EVENT_OK(metadata, len); metadata = FAN_EVENT_NEXT(metadata, len))
+        {
+          if (metadata->vers != FANOTIFY_METADATA_VERSION)
+            {
+              LOG_ERROR("%s: %s",
+                  watcher->name, N_("unsupported fanotify metadata version"));
+
+              return TRUE;
+            }
+
+          if (metadata->mask & FAN_Q_OVERFLOW)
+            {
+              LOG_ERROR("%s: %s",
+                  watcher->name, N_("fanotify event queue overflow"));
+
+              rescan_request(watcher);
+
+              continue;
+            }
+
+          if (metadata->event_len < sizeof(*metadata) + sizeof(*info))
+            continue;
+
+          info = (struct fanotify_event_info_fid *) (metadata + 1);
+          if ((info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME)
+              && (info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID))
+            continue;
+
+          handle = (struct file_handle *) info->handle;
+          name = NULL;
+          if (info->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID_NAME)
+            name = (const gchar *) handle->f_handle + handle->handle_bytes;
+
+          /* renamed or deleted directories invalidate the cached paths */
+          if ((metadata->mask & FAN_ONDIR)
+              && (metadata->mask & (FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO)))
+            g_hash_table_remove_all(fanotify->handles);
+
+          dir = monitor_fanotify_resolve(fanotify, handle);
+          if (!dir)
+            continue;
+
+          if (name && (g_strcmp0(name, ".") != 0))
+            file = g_build_path(G_DIR_SEPARATOR_S, dir, name, NULL);
+          else
+            file = g_strdup(dir);
+
+          g_free(dir);
+
+          rfile = watcher_get_relative_path(watcher, file);
+          if (!rfile)
+            {
+              g_free(file);
+
+              continue;
+            }
+
+          for (depth = 1; *rfile; rfile++)
+            {
+              if (*rfile == G_DIR_SEPARATOR)
+                depth++;
+            }
+
+          if ((!watcher->recursive && (depth > 1))
+              || ((watcher->maxdepth > 0) && (depth > watcher->maxdepth))
+              || (watcher->prunes && monitor_fanotify_is_pruned(watcher, file)))
+            {
+              g_free(file);
+
+              continue;
+            }
+
+          for (i = 0; i < G_N_ELEMENTS(monitor_fanotify_events); i++)
+            {
+              if (metadata->mask & monitor_fanotify_events[i].mask)
+                watcher_event_process(watcher, file,
+                    monitor_fanotify_events[i].event_type);
+            }
+
+          g_free(file);
+        }
+    }
+
+  if ((len < 0) && (errno != EAGAIN) && (errno != EINTR))
+    {
+      LOG_ERROR("%s: %s (%s)",
+          watcher->name, N_("failed to read fanotify events"), g_strerror(errno));
+    }
+
+  return TRUE;
+}
+
+#endif /* MONITOR_FANOTIFY_SUPPORTED */
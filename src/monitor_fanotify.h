@@ -0,0 +1,57 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef MONITOR_FANOTIFY_H_
+#define MONITOR_FANOTIFY_H_
+
+#include "common.h"
+
+#ifdef OS_LINUX
+#include <sys/fanotify.h>
+#if defined(FAN_REPORT_DFID_NAME) && defined(FAN_MARK_FILESYSTEM)
+#define MONITOR_FANOTIFY_SUPPORTED
+#endif
+#endif
+
+#ifdef MONITOR_FANOTIFY_SUPPORTED
+
+struct _watcher_t;
+
+typedef struct _monitor_fanotify_t
+{
+  gint fd;
+  gint mount_fd;
+  GIOChannel *channel;
+  guint source;
+  GHashTable *handles;
+  struct _watcher_t *watcher;
+} monitor_fanotify_t;
+
+gboolean
+monitor_fanotify_create(struct _watcher_t *watcher);
+void
+monitor_fanotify_destroy(struct _watcher_t *watcher);
+gboolean
+monitor_fanotify_event(GIOChannel *channel, GIOCondition condition,
+    gpointer user_data);
+
+#endif /* MONITOR_FANOTIFY_SUPPORTED */
+
+#endif /* MONITOR_FANOTIFY_H_ */
@@ -0,0 +1,456 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "fmon.h"
+#include "monitor_inotify.h"
+#include "rescan.h"
+#include "statcache.h"
+#include "tree.h"
+#include "watcher.h"
+
+#ifdef OS_LINUX
+
+#include <sys/inotify.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define MONITOR_INOTIFY_BUFFER  65536
+#define MONITOR_INOTIFY_PATHS   4096
+
+static guint32
+monitor_inotify_get_mask(const watcher_t *watcher)
+{
+  guint events;
+  guint32 mask = 0;
+
+  events = watcher_get_required_events(watcher);
+
+  if (events & WATCHER_EVENT_CREATED)
+    mask |= IN_CREATE | IN_MOVED_TO;
+
+  if (events & WATCHER_EVENT_DELETED)
+    mask |= IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF;
+
+  if (events & WATCHER_EVENT_CHANGED)
+    mask |= IN_MODIFY;
+
+  if (events & WATCHER_EVENT_CHANGING)
+    mask |= IN_CLOSE_WRITE;
+
+  if (events & WATCHER_EVENT_ATTRIBUTECHANGED)
+    mask |= IN_ATTRIB;
+
+  /* the kernel refuses an empty mask */
+  if (!mask)
+    mask = IN_DELETE_SELF;
+
+  return mask;
+}
+
+static guint
+monitor_inotify_get_limit()
+{
+  GError *error = NULL;
+  gchar *contents;
+  gint64 limit = 0;
+  gint max;
+
+  max = g_key_file_get_integer(app->settings, CONFIG_GROUP_MAIN,
+      CONFIG_KEY_MAIN_MAXWATCHES, &error);
+  if (error)
+    {
+      max = CONFIG_KEY_MAIN_MAXWATCHES_DEFAULT;
+
+      g_error_free(error);
+      error = NULL;
+    }
+
+  /* the kernel limit is shared by all the processes of the user */
+  if (g_file_get_contents(MONITOR_INOTIFY_MAX_USER_WATCHES, &contents, NULL,
+      NULL))
+    {
+      limit = g_ascii_strtoll(contents, NULL, 10);
+
+      g_free(contents);
+    }
+
+  if ((max > 0) && ((limit <= 0) || (max < limit)))
+    limit = max;
+
+  return (limit > 0) && (limit <= G_MAXUINT) ? (guint) limit : 0;
+}
+
+gboolean
+monitor_inotify_create()
+{
+  monitor_inotify_t *inotify;
+  gint fd;
+
+  LOG_DEBUG("%s", "creating inotify monitor");
+
+  fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0)
+    {
+      LOG_ERROR("%s (%s)", N_("failed to create inotify monitor"),
+          g_strerror(errno));
+
+      return FALSE;
+    }
+
+  inotify = g_new0(monitor_inotify_t, 1);
+  inotify->fd = fd;
+  inotify->watches = g_hash_table_new(g_direct_hash, g_direct_equal);
+  inotify->paths = g_string_sized_new(MONITOR_INOTIFY_PATHS);
+  inotify->targets = g_array_new(FALSE, FALSE,
+      sizeof(monitor_inotify_target_t));
+  inotify->limit = monitor_inotify_get_limit();
+  inotify->channel = g_io_channel_unix_new(fd);
+  inotify->source = g_io_add_watch(inotify->channel, G_IO_IN,
+      monitor_inotify_event, inotify);
+
+  app->inotify = inotify;
+
+  LOG_INFO("%s (limit=%u)", N_("inotify watch budget"), inotify->limit);
+
+  return TRUE;
+}
+
+void
+monitor_inotify_destroy()
+{
+  monitor_inotify_t *inotify;
+  monitor_inotify_watch_t *watch;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  if (!app->inotify)
+    return;
+
+  LOG_DEBUG("%s", "destroying inotify monitor");
+
+  inotify = app->inotify;
+
+  g_source_remove(inotify->source);
+  g_io_channel_unref(inotify->channel);
+
+  g_hash_table_iter_init(&iter, inotify->watches);
+  while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+      watch = (monitor_inotify_watch_t *) value;
+
+      g_slist_free(watch->nodes);
+      g_free(watch);
+    }
+
+  g_hash_table_destroy(inotify->watches);
+  g_string_free(inotify->paths, TRUE);
+  g_array_free(inotify->targets, TRUE);
+  close(inotify->fd);
+  g_free(inotify);
+
+  app->inotify = NULL;
+}
+
+gboolean
+monitor_inotify_admit()
+{
+  monitor_inotify_t *inotify;
+
+  inotify = app->inotify;
+  if (!inotify)
+    return FALSE;
+
+  if (inotify->exhausted)
+    {
+      inotify->refused++;
+
+      return FALSE;
+    }
+
+  if (inotify->limit
+      && (g_hash_table_size(inotify->watches) >= inotify->limit))
+    {
+      LOG_ERROR("%s (limit=%u)",
+          N_("inotify watch budget exhausted, polling directories"),
+          inotify->limit);
+
+      inotify->exhausted = TRUE;
+      inotify->refused++;
+
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+monitor_inotify_watch_t *
+monitor_inotify_add_watch(tree_node_t *node, const gchar *path)
+{
+  monitor_inotify_t *inotify;
+  watcher_t *watcher;
+  monitor_inotify_watch_t *watch;
+  guint32 mask;
+  gint wd;
+
+  inotify = app->inotify;
+  if (!inotify)
+    return NULL;
+
+  watcher = (watcher_t *) tree_node_get_tree(node)->data;
+  mask = monitor_inotify_get_mask(watcher);
+
+  /* the mask of a shared watch is the union of the masks of its watchers */
+  wd = inotify_add_watch(inotify->fd, path, mask | IN_MASK_ADD);
+  if ((wd < 0) && (errno == ENOSPC))
+    {
+      LOG_ERROR("%s: %s (path=%s, used=%u)",
+          watcher->name, N_("inotify watch limit reached, polling directories"),
+          path, g_hash_table_size(inotify->watches));
+
+      inotify->exhausted = TRUE;
+      inotify->refused++;
+
+      return NULL;
+    }
+  if (wd < 0)
+    {
+      LOG_ERROR("%s: %s (path=%s, %s)",
+          watcher->name, N_("failed to add inotify watch"), path, g_strerror(errno));
+
+      return NULL;
+    }
+
+  /* the kernel returns the same descriptor for an inode already watched, so
+   * watchers sharing a directory share one watch, each watcher keeping its
+   * own node of its monitor tree in the watch */
+  watch = g_hash_table_lookup(inotify->watches, GINT_TO_POINTER(wd));
+  if (!watch)
+    {
+      watch = g_new0(monitor_inotify_watch_t, 1);
+      watch->wd = wd;
+
+      g_hash_table_insert(inotify->watches, GINT_TO_POINTER(wd), watch);
+    }
+
+  watch->mask |= mask;
+
+  if (!g_slist_find(watch->nodes, node))
+    watch->nodes = g_slist_prepend(watch->nodes, node);
+
+  return watch;
+}
+
+void
+monitor_inotify_remove_watch(tree_node_t *node,
+    monitor_inotify_watch_t *watch)
+{
+  monitor_inotify_t *inotify;
+  monitor_inotify_watch_t *other;
+  GSList *item;
+  guint32 mask = 0;
+  gchar *path;
+  gint wd;
+
+  inotify = app->inotify;
+
+  watch->nodes = g_slist_remove(watch->nodes, node);
+  if (watch->nodes)
+    {
+      for (item = watch->nodes; item; item = item->next)
+        mask |= monitor_inotify_get_mask(
+            tree_node_get_tree((tree_node_t *) item->data)->data);
+
+      /* shrink the mask to the events of the remaining watchers */
+      if (inotify && (watch->wd >= 0) && (mask != watch->mask))
+        {
+          path = tree_node_get_path((tree_node_t *) watch->nodes->data);
+
+          /* the path may name another inode since it was watched, whose
+           * watch is then restored, or removed if the call created it */
+          wd = inotify_add_watch(inotify->fd, path, mask);
+          if (wd == watch->wd)
+            {
+              watch->mask = mask;
+            }
+          else if (wd >= 0)
+            {
+              other = g_hash_table_lookup(inotify->watches,
+                  GINT_TO_POINTER(wd));
+              if (other)
+                inotify_add_watch(inotify->fd, path, other->mask);
+              else
+                inotify_rm_watch(inotify->fd, wd);
+            }
+
+          g_free(path);
+        }
+
+      return;
+    }
+
+  if (inotify && (watch->wd >= 0))
+    {
+      g_hash_table_remove(inotify->watches, GINT_TO_POINTER(watch->wd));
+      inotify_rm_watch(inotify->fd, watch->wd);
+    }
+
+  /* the polled directories may be watched again */
+  if (inotify)
+    inotify->exhausted = FALSE;
+
+  g_free(watch);
+}
+
+gboolean
+monitor_inotify_event(GIOChannel *channel, GIOCondition condition,
+    gpointer user_data)
+{
+  monitor_inotify_t *inotify;
+  monitor_inotify_watch_t *watch;
+  const struct inotify_event *ievent;
+  GFileMonitorEvent event_type;
+  monitor_inotify_target_t target;
+  GSList *item;
+  tree_node_t *node;
+  guint i;
+  gchar buffer[MONITOR_INOTIFY_BUFFER]
+      __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  gssize len;
+  gchar *ptr;
+
+  inotify = (monitor_inotify_t *) user_data;
+
+  while ((len = read(inotify->fd, buffer, sizeof(buffer))) > 0)
+    {
+      statcache_begin();
+
+      for (ptr = buffer; ptr < buffer + len;
+          ptr += sizeof(struct inotify_event) + ievent->len)
+        {
+          ievent = (const struct inotify_event *) ptr;
+
+          if (ievent->mask & IN_Q_OVERFLOW)
+            {
+              LOG_ERROR("%s", N_("inotify event queue overflow"));
+
+              /* the lost events may concern any watcher of the backend */
+              for (item = app->watchers; item; item = item->next)
+                {
+                  if (((watcher_t *) item->data)->backend
+                      == WATCHER_BACKEND_INOTIFY)
+                    rescan_request((watcher_t *) item->data);
+                }
+
+              continue;
+            }
+
+          watch = g_hash_table_lookup(inotify->watches,
+              GINT_TO_POINTER(ievent->wd));
+          if (!watch)
+            continue;
+
+          if (ievent->mask & IN_IGNORED)
+            {
+              /* the kernel dropped the watch, the watchers will release it */
+              g_hash_table_remove(inotify->watches, GINT_TO_POINTER(watch->wd));
+              watch->wd = -1;
+              inotify->exhausted = FALSE;
+
+              continue;
+            }
+
+          if (ievent->mask & (IN_CREATE | IN_MOVED_TO))
+            event_type = G_FILE_MONITOR_EVENT_CREATED;
+          else if (ievent->mask & (IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF))
+            event_type = G_FILE_MONITOR_EVENT_DELETED;
+          else if (ievent->mask & IN_MODIFY)
+            event_type = G_FILE_MONITOR_EVENT_CHANGED;
+          else if (ievent->mask & IN_CLOSE_WRITE)
+            event_type = G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT;
+          else if (ievent->mask & IN_ATTRIB)
+            event_type = G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED;
+          else
+            continue;
+
+          /* the watchers may release this watch and their nodes while
+           * processing the event, so the paths are built beforehand in a
+           * buffer reused for every event */
+          g_string_truncate(inotify->paths, 0);
+          g_array_set_size(inotify->targets, 0);
+
+          for (item = watch->nodes; item; item = item->next)
+            {
+              node = (tree_node_t *) item->data;
+
+              /* events on a watched directory itself are already reported by
+               * the watch of its parent, except for the watcher root */
+              if ((ievent->len == 0) && node->parent)
+                continue;
+
+              /* the event may only be wanted by another watcher */
+              if (!(ievent->mask & monitor_inotify_get_mask(
+                  tree_node_get_tree(node)->data)))
+                continue;
+
+              target.watcher = tree_node_get_tree(node)->data;
+              target.offset = inotify->paths->len;
+              g_array_append_val(inotify->targets, target);
+
+              tree_node_append_path(node,
+                  (ievent->len > 0) ? ievent->name : NULL, inotify->paths);
+              g_string_append_c(inotify->paths, '\0');
+            }
+
+          for (i = 0; i < inotify->targets->len; i++)
+            {
+              target = g_array_index(inotify->targets,
+                  monitor_inotify_target_t, i);
+
+              watcher_event_process(target.watcher,
+                  inotify->paths->str + target.offset, event_type);
+            }
+        }
+    }
+
+  if ((len < 0) && (errno != EAGAIN) && (errno != EINTR))
+    {
+      LOG_ERROR("%s (%s)", N_("failed to read inotify events"),
+          g_strerror(errno));
+    }
+
+  return TRUE;
+}
+
+void
+monitor_inotify_list()
+{
+  monitor_inotify_t *inotify;
+
+  inotify = app->inotify;
+  if (!inotify)
+    return;
+
+  LOG_INFO("%s (used=%u, limit=%u, exhausted=%s, refused=%" G_GUINT64_FORMAT
+      ")",
+      N_("inotify watch budget"), g_hash_table_size(inotify->watches),
+      inotify->limit, inotify->exhausted ? "yes" : "no", inotify->refused);
+}
+
+#endif /* OS_LINUX */
@@ -0,0 +1,77 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef MONITOR_INOTIFY_H_
+#define MONITOR_INOTIFY_H_
+
+#include "common.h"
+
+#ifdef OS_LINUX
+
+struct _tree_node_t;
+struct _watcher_t;
+
+typedef struct _monitor_inotify_watch_t
+{
+  gint wd;
+  guint32 mask;
+  GSList *nodes;
+} monitor_inotify_watch_t;
+
+typedef struct _monitor_inotify_target_t
+{
+  struct _watcher_t *watcher;
+  gsize offset;
+} monitor_inotify_target_t;
+
+typedef struct _monitor_inotify_t
+{
+  gint fd;
+  GIOChannel *channel;
+  guint source;
+  GHashTable *watches;
+  GString *paths;
+  GArray *targets;
+  guint limit;
+  gboolean exhausted;
+  guint64 refused;
+#define MONITOR_INOTIFY_MAX_USER_WATCHES "/proc/sys/fs/inotify/max_user_watches"
+} monitor_inotify_t;
+
+gboolean
+monitor_inotify_create();
+void
+monitor_inotify_destroy();
+gboolean
+monitor_inotify_admit();
+monitor_inotify_watch_t *
+monitor_inotify_add_watch(struct _tree_node_t *node, const gchar *path);
+void
+monitor_inotify_remove_watch(struct _tree_node_t *node,
+    monitor_inotify_watch_t *watch);
+gboolean
+monitor_inotify_event(GIOChannel *channel, GIOCondition condition,
+    gpointer user_data);
+void
+monitor_inotify_list();
+
+#endif /* OS_LINUX */
+
+#endif /* MONITOR_INOTIFY_H_ */
@@ -19,7 +19,10 @@
  */
 
 #include "fmon.h"
+#include "filter.h"
 #include "mount.h"
+#include "statcache.h"
+#include "tree.h"
 #include "watcher.h"
 
 void
@@ -57,28 +60,107 @@ mount_destroy()
   g_list_free(app->mounts);
 }
 
+static void
+mount_event_dispatch(const gchar *mountpath, guint mask)
+{
+  GSList *item;
+  tree_node_t *node;
+  gboolean matched;
+  guint depth = 1;
+  watcher_t *watcher;
+  watcher_event_t event;
+
+  for (item = app->watchers; item; item = item->next)
+    {
+      watcher = (watcher_t *) item->data;
+
+      event.rfile = watcher_get_relative_path(watcher, mountpath);
+      if (!event.rfile)
+        {
+          LOG_DEBUG("%s: %s",
+              watcher->name, N_("path has not the same prefix"));
+
+          continue;
+        }
+
+      matched = (*event.rfile == '\0');
+      if (matched)
+        {
+          LOG_DEBUG("%s: %s (%s)",
+              watcher->name, N_("path matches"), mountpath);
+        }
+
+      if (!matched && watcher->recursive)
+        {
+          node = tree_lookup(watcher->monitors, mountpath);
+          if (node && node->monitor)
+            {
+              matched = TRUE;
+
+              LOG_DEBUG("%s: %s (%s)",
+                  watcher->name, N_("path matches"), mountpath);
+            }
+        }
+
+      if (!matched)
+        continue;
+
+      event.watcher = watcher;
+      event.event = watcher_get_event_name(mask);
+      event.mask = mask;
+      event.file = mountpath;
+
+      if (watcher->recursive)
+        {
+          depth = watcher_get_depth(watcher, mountpath);
+
+          LOG_DEBUG("%s: file depth to watcher path is '%d'",
+              watcher->name, depth);
+
+          watcher_remove_monitor_for_recursive_path(watcher, mountpath);
+          watcher_add_monitor_for_recursive_path(watcher, mountpath, depth);
+        }
+      else
+        {
+          watcher_remove_monitor_for_path(watcher, watcher->path);
+          watcher_add_monitor_for_path(watcher, watcher->path);
+        }
+
+      LOG_INFO("%s: %s", watcher->name, N_("watcher updated"));
+
+      if (!watcher_event_test(watcher, &event))
+        {
+          LOG_DEBUG("%s: %s (event=%s, file=%s)",
+              watcher->name, N_("event ignored"), event.event, event.file);
+
+          continue;
+        }
+
+      watcher_event_fired(watcher, &event);
+    }
+}
+
 void
 mount_event(GUnixMountMonitor *monitor, gpointer user_data)
 {
-  GFile *m_file, *w_file, *parent, *top, *tmp;
   GUnixMountEntry *mount1, *mount2;
   GList *mounts, *item1, *item2;
   GSList *item3;
-  GHashTableIter iter;
-  gpointer key, value;
   const gchar *mountpath;
-  gchar *path;
-  gboolean found, matched;
-  gint depth = 1;
-  watcher_t *watcher;
-  watcher_event_t *event;
+  gboolean found;
 
   LOG_DEBUG("%s: %s", "mount", N_("mount event received"));
 
+  statcache_begin();
+
+  /* the watcher roots may have moved to another filesystem */
+  for (item3 = app->watchers; item3; item3 = item3->next)
+    filter_reset_root(((watcher_t *) item3->data)->filter);
+
   mounts = g_unix_mounts_get(NULL);
 
-  for (item1 = app->mounts, found = FALSE, matched = FALSE; item1;
-      item1 = item1->next, found = FALSE, matched = FALSE)
+  for (item1 = app->mounts, found = FALSE; item1;
+      item1 = item1->next, found = FALSE)
     {
       mount1 = (GUnixMountEntry *) item1->data;
 
@@ -100,134 +182,19 @@ mount_event(GUnixMountMonitor *monitor, gpointer user_data)
 
           LOG_INFO("%s: %s '%s'", "mount", N_("path unmounted"), mountpath);
 
-          m_file = g_file_new_for_path(mountpath);
-          if (!g_file_has_parent(m_file, NULL))
+          if (g_strcmp0(mountpath, "/") == 0)
             {
               LOG_DEBUG("%s: %s", "mount", N_("path has no parent"));
 
-              g_object_unref(m_file);
-
               continue;
             }
 
-          for (item3 = app->watchers; item3; item3 = item3->next)
-            {
-              watcher = (watcher_t *) item3->data;
-
-              w_file = g_file_new_for_path(watcher->path);
-              if (g_file_equal(m_file, w_file))
-                {
-                  LOG_DEBUG("%s: %s (%s)",
-                      watcher->name, N_("path matches"), mountpath);
-
-                  matched = TRUE;
-                }
-              else if (!g_file_has_prefix(m_file, w_file))
-                {
-                  LOG_DEBUG("%s: %s",
-                      watcher->name, N_("path has not the same prefix"));
-
-                  g_object_unref(w_file);
-
-                  continue;
-                }
-
-              if (!matched && watcher->recursive)
-                {
-                  g_hash_table_iter_init(&iter, watcher->monitors);
-                  while (g_hash_table_iter_next(&iter, &key, &value))
-                    {
-                      path = (gchar *) key;
-
-                      w_file = g_file_new_for_path(path);
-
-                      if (g_file_equal(w_file, m_file))
-                        {
-                          matched = TRUE;
-
-                          LOG_DEBUG("%s: %s (%s)",
-                              watcher->name, N_("path matches"), mountpath);
-
-                          break;
-                        }
-                    }
-                }
-
-              if (matched)
-                {
-                  parent = g_file_new_for_path(watcher->path);
-
-                  event = (watcher_event_t *) g_new0(watcher_event_t, 1);
-                  event->watcher = watcher;
-                  event->event = g_strdup(CONFIG_KEY_WATCHER_EVENT_UNMOUNTED);
-                  event->file = g_file_get_path(m_file);
-                  event->rfile = g_file_get_relative_path(parent, m_file);
-
-                  if (watcher->recursive)
-                    {
-                      for (top = g_file_dup(m_file), depth = 1;
-                          !g_file_equal(top, parent)
-                                  && !g_file_has_parent(top, parent);
-                          top = tmp, depth++)
-                        {
-                          tmp = g_file_get_parent(top);
-
-                          g_object_unref(top);
-                        }
-
-                      g_object_unref(top);
-
-                      LOG_DEBUG("%s: file depth to watcher path is '%d'",
-                          watcher->name, depth);
-                    }
-
-                  g_object_unref(parent);
-
-                  if (watcher->recursive)
-                    {
-                      watcher_remove_monitor_for_recursive_path(watcher,
-                          event->file);
-                      watcher_add_monitor_for_recursive_path(watcher,
-                          event->file, depth);
-                    }
-                  else
-                    {
-                      watcher_remove_monitor_for_path(watcher, watcher->path);
-                      watcher_add_monitor_for_path(watcher, watcher->path);
-                    }
-
-                  LOG_INFO("%s: %s", watcher->name, N_("watcher updated"));
-
-                  if (!watcher_event_test(watcher, event))
-                    {
-                      LOG_DEBUG("%s: %s (event=%s, file=%s)",
-                          watcher->name, N_("event ignored"), event->event, event->file);
-
-                      g_free(event->event);
-                      g_free(event->file);
-                      g_free(event->rfile);
-                      g_free(event);
-
-                      return;
-                    }
-
-                  watcher_event_fired(watcher, event);
-
-                  g_free(event->event);
-                  g_free(event->file);
-                  g_free(event->rfile);
-                  g_free(event);
-                }
-
-              g_object_unref(w_file);
-            }
-
-          g_object_unref(m_file);
+          mount_event_dispatch(mountpath, WATCHER_EVENT_UNMOUNTED);
         }
     }
 
-  for (item1 = mounts, found = FALSE, matched = FALSE; item1;
-      item1 = item1->next, found = FALSE, matched = FALSE)
+  for (item1 = mounts, found = FALSE; item1;
+      item1 = item1->next, found = FALSE)
     {
       mount1 = (GUnixMountEntry *) item1->data;
 
@@ -249,131 +216,14 @@ mount_event(GUnixMountMonitor *monitor, gpointer user_data)
 
           LOG_INFO("%s: %s '%s'", "mount", N_("path mounted"), mountpath);
 
-          m_file = g_file_new_for_path(mountpath);
-          if (!g_file_has_parent(m_file, NULL))
+          if (g_strcmp0(mountpath, "/") == 0)
             {
               LOG_DEBUG("%s: %s", "mount", N_("path has no parent"));
 
-              g_object_unref(m_file);
-
               continue;
             }
 
-          for (item3 = app->watchers; item3; item3 = item3->next)
-            {
-              watcher = (watcher_t *) item3->data;
-
-              w_file = g_file_new_for_path(watcher->path);
-              if (g_file_equal(m_file, w_file))
-                {
-                  LOG_DEBUG("%s: %s (%s)",
-                      watcher->name, N_("path matches"), mountpath);
-
-                  matched = TRUE;
-                }
-              else if (!g_file_has_prefix(m_file, w_file))
-                {
-                  LOG_DEBUG("%s: %s",
-                      watcher->name, N_("path has not the same prefix"));
-
-                  g_object_unref(w_file);
-
-                  continue;
-                }
-
-              if (!matched && watcher->recursive)
-                {
-                  g_hash_table_iter_init(&iter, watcher->monitors);
-                  while (g_hash_table_iter_next(&iter, &key, &value))
-                    {
-                      path = (gchar *) key;
-
-                      w_file = g_file_new_for_path(path);
-
-                      if (g_file_equal(w_file, m_file))
-                        {
-                          matched = TRUE;
-
-                          LOG_DEBUG("%s: %s (%s)",
-                              watcher->name, N_("path matches"), mountpath);
-
-                          break;
-                        }
-                    }
-                }
-
-              if (matched)
-                {
-                  parent = g_file_new_for_path(watcher->path);
-
-                  event = (watcher_event_t *) g_new0(watcher_event_t, 1);
-                  event->watcher = watcher;
-                  event->event = g_strdup(CONFIG_KEY_WATCHER_EVENT_MOUNTED);
-                  event->file = g_file_get_path(m_file);
-                  event->rfile = g_file_get_relative_path(parent, m_file);
-
-                  if (watcher->recursive)
-                    {
-                      depth = 1;
-
-                      for (top = g_file_dup(m_file), depth = 1;
-                          !g_file_equal(top, parent)
-                                  && !g_file_has_parent(top, parent);
-                          top = tmp, depth++)
-                        {
-                          tmp = g_file_get_parent(top);
-
-                          g_object_unref(top);
-                        }
-
-                      g_object_unref(top);
-
-                      LOG_DEBUG("%s: file depth to watcher path is '%d'",
-                          watcher->name, depth);
-                    }
-
-                  g_object_unref(parent);
-
-                  if (watcher->recursive)
-                    {
-                      watcher_remove_monitor_for_recursive_path(watcher,
-                          event->file);
-                      watcher_add_monitor_for_recursive_path(watcher,
-                          event->file, depth);
-                    }
-                  else
-                    {
-                      watcher_remove_monitor_for_path(watcher, watcher->path);
-                      watcher_add_monitor_for_path(watcher, watcher->path);
-                    }
-
-                  LOG_INFO("%s: %s", watcher->name, N_("watcher updated"));
-
-                  if (!watcher_event_test(watcher, event))
-                    {
-                      LOG_DEBUG("%s: %s (event=%s, file=%s)",
-                          watcher->name, N_("event ignored"), event->event, event->file);
-
-                      g_free(event->event);
-                      g_free(event->file);
-                      g_free(event->rfile);
-                      g_free(event);
-
-                      return;
-                    }
-
-                  watcher_event_fired(watcher, event);
-
-                  g_free(event->event);
-                  g_free(event->file);
-                  g_free(event->rfile);
-                  g_free(event);
-                }
-
-              g_object_unref(w_file);
-            }
-
-          g_object_unref(m_file);
+          mount_event_dispatch(mountpath, WATCHER_EVENT_MOUNTED);
         }
     }
 
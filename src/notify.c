@@ -0,0 +1,164 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "fmon.h"
+#include "notify.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * The service manager is told that the watchers are ready once every initial
+ * crawl is done, with the sd_notify protocol when NOTIFY_SOCKET is set, and
+ * with a ready file when one is configured.
+ */
+
+static void
+notify_send(const gchar *state)
+{
+  struct sockaddr_un addr;
+  const gchar *path;
+  gsize len;
+  gint fd;
+
+  path = g_getenv("NOTIFY_SOCKET");
+  if (!path || ((path[0] != '/') && (path[0] != '@')))
+    return;
+
+  len = strlen(path);
+  if (len >= sizeof(addr.sun_path))
+    {
+      LOG_ERROR("%s (%s)", N_("notification socket path too long"), path);
+
+      return;
+    }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path, len);
+
+  /* a leading '@' stands for the abstract namespace */
+  if (addr.sun_path[0] == '@')
+    addr.sun_path[0] = '\0';
+
+  fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  if (fd < 0)
+    {
+      LOG_ERROR("%s (%s)", N_("failed to create notification socket"),
+          g_strerror(errno));
+
+      return;
+    }
+
+  if (sendto(fd, state, strlen(state), 0, (struct sockaddr *) &addr,
+      offsetof(struct sockaddr_un, sun_path) + len) < 0)
+    {
+      LOG_ERROR("%s (%s, %s)", N_("failed to send notification"), path,
+          g_strerror(errno));
+    }
+
+  close(fd);
+}
+
+static gchar *
+notify_get_ready_file()
+{
+  GError *error = NULL;
+  gchar *ready_file;
+
+  ready_file = g_key_file_get_string(app->settings, CONFIG_GROUP_MAIN,
+      CONFIG_KEY_MAIN_READYFILE, &error);
+  if (error)
+    {
+      g_error_free(error);
+
+      return NULL;
+    }
+
+  return ready_file;
+}
+
+void
+notify_crawl_started()
+{
+  app->crawling++;
+}
+
+void
+notify_crawl_done()
+{
+  if (app->crawling == 0)
+    return;
+
+  app->crawling--;
+  if (app->crawling == 0)
+    notify_ready();
+}
+
+void
+notify_ready()
+{
+  GError *error = NULL;
+  gchar *ready_file, *state;
+
+  LOG_INFO("%s", N_("watchers ready"));
+
+  state = g_strdup_printf("READY=1\nMAINPID=%d\nSTATUS=%s", (gint) getpid(),
+      N_("watchers ready"));
+  notify_send(state);
+  g_free(state);
+
+  ready_file = notify_get_ready_file();
+  if (!ready_file)
+    return;
+
+  state = g_strdup_printf("%d\n", (gint) getpid());
+  if (!g_file_set_contents(ready_file, state, -1, &error))
+    {
+      LOG_ERROR("%s (%s)", N_("failed to write ready file"), error->message);
+
+      g_error_free(error);
+    }
+
+  g_free(state);
+  g_free(ready_file);
+}
+
+void
+notify_stopped()
+{
+  gchar *ready_file;
+
+  app->crawling = 0;
+
+  notify_send("STATUS=" N_("watchers stopped"));
+
+  ready_file = notify_get_ready_file();
+  if (!ready_file)
+    return;
+
+  g_unlink(ready_file);
+  g_free(ready_file);
+}
@@ -0,0 +1,426 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "fmon.h"
+#include "pattern.h"
+
+#include <string.h>
+
+/*
+ * A set of patterns is matched with hash lookups whatever its size: the
+ * patterns without wildcard, the "*suffix" and the "prefix*" patterns are
+ * stored in hash sets, which are probed with the file, its suffixes and its
+ * prefixes. Only the other patterns are matched one by one.
+ *
+ * A pattern with "**" or ending with a separator is a path pattern: "*" and
+ * "?" don't match a separator in it while "**" matches any number of
+ * directories, and "dir/" matches a directory and all its content. In the
+ * other patterns "*" matches any string like g_pattern_match().
+ */
+
+static gboolean
+pattern_has_wildcard(const gchar *str, gsize len)
+{
+  gsize i;
+
+  for (i = 0; i < len; i++)
+    {
+      if ((str[i] == '*') || (str[i] == '?'))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+pattern_set_add_string(GHashTable **table, const gchar *str, gsize len,
+    gsize *max)
+{
+  gchar *key;
+
+  if (!*table)
+    *table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  key = g_strndup(str, len);
+  g_hash_table_insert(*table, key, key);
+
+  if (max && (len > *max))
+    *max = len;
+}
+
+static void
+pattern_set_add(pattern_set_t *set, const gchar *pattern, gboolean path)
+{
+  const gchar *rest;
+  gchar *str;
+  gsize len;
+
+  len = strlen(pattern);
+
+  if (!pattern_has_wildcard(pattern, len))
+    {
+      pattern_set_add_string(&set->literals, pattern, len, NULL);
+
+      return;
+    }
+
+  if (!path)
+    {
+      if (strspn(pattern, "*") == len)
+        set->any = TRUE;
+      else if ((pattern[0] == '*')
+          && !pattern_has_wildcard(pattern + 1, len - 1))
+        pattern_set_add_string(&set->suffixes, pattern + 1, len - 1,
+            &set->max_suffix);
+      else if ((pattern[len - 1] == '*')
+          && !pattern_has_wildcard(pattern, len - 1))
+        pattern_set_add_string(&set->prefixes, pattern, len - 1,
+            &set->max_prefix);
+      else
+        set->specs[set->n_specs++] = g_pattern_spec_new(pattern);
+
+      return;
+    }
+
+  if ((g_strcmp0(pattern, "**") == 0) || (g_strcmp0(pattern, "**/*") == 0))
+    {
+      set->any = TRUE;
+
+      return;
+    }
+
+  if (g_str_has_prefix(pattern, "**/"))
+    {
+      rest = pattern + 3;
+
+      /* a name at any depth */
+      if (!strchr(rest, G_DIR_SEPARATOR)
+          && !pattern_has_wildcard(rest, len - 3))
+        {
+          pattern_set_add_string(&set->literals, rest, len - 3, NULL);
+          pattern_set_add_string(&set->suffixes, pattern + 2, len - 2,
+              &set->max_suffix);
+
+          return;
+        }
+
+      /* a name suffix at any depth */
+      if (!strchr(rest, G_DIR_SEPARATOR) && (rest[0] == '*')
+          && !pattern_has_wildcard(rest + 1, len - 4))
+        {
+          pattern_set_add_string(&set->suffixes, rest + 1, len - 4,
+              &set->max_suffix);
+
+          return;
+        }
+    }
+
+  /* the content of a directory */
+  if (g_str_has_suffix(pattern, "/**")
+      && !pattern_has_wildcard(pattern, len - 2))
+    {
+      pattern_set_add_string(&set->prefixes, pattern, len - 2,
+          &set->max_prefix);
+
+      return;
+    }
+
+  str = g_strdup(pattern);
+  set->globs[set->n_globs++] = str;
+}
+
+static gboolean
+pattern_glob_match(const gchar *pattern, const gchar *str)
+{
+  const gchar *p, *s;
+
+  p = pattern;
+  s = str;
+
+  while (*p)
+    {
+      if ((p[0] == '*') && (p[1] == '*'))
+        {
+          while (*p == '*')
+            p++;
+
+          if (*p == G_DIR_SEPARATOR)
+            {
+              /* zero or more directories */
+              p++;
+
+              for (;;)
+                {
+                  if (pattern_glob_match(p, s))
+                    return TRUE;
+
+                  s = strchr(s, G_DIR_SEPARATOR);
+                  if (!s)
+                    return FALSE;
+
+                  s++;
+                }
+            }
+
+          for (;; s++)
+            {
+              if (pattern_glob_match(p, s))
+                return TRUE;
+
+              if (*s == '\0')
+                return FALSE;
+            }
+        }
+      else if (*p == '*')
+        {
+          p++;
+
+          for (;; s++)
+            {
+              if (pattern_glob_match(p, s))
+                return TRUE;
+
+              if ((*s == '\0') || (*s == G_DIR_SEPARATOR))
+                return FALSE;
+            }
+        }
+      else if (*p == '?')
+        {
+          if ((*s == '\0') || (*s == G_DIR_SEPARATOR))
+            return FALSE;
+
+          p++;
+          s = g_utf8_next_char(s);
+        }
+      else
+        {
+          if (*p != *s)
+            return FALSE;
+
+          p++;
+          s++;
+        }
+    }
+
+  return *s == '\0';
+}
+
+pattern_set_t *
+pattern_set_new(gchar **patterns)
+{
+  pattern_set_t *set;
+  const gchar *pattern;
+  gchar *dir, *content;
+  gsize len;
+  guint n;
+  gint i;
+
+  if (!patterns)
+    return NULL;
+
+  n = g_strv_length(patterns);
+
+  set = g_new0(pattern_set_t, 1);
+  set->specs = g_new0(GPatternSpec *, n + 1);
+  set->globs = g_new0(gchar *, 2 * n + 1);
+
+  for (i = 0; patterns[i] != NULL; i++)
+    {
+      /* the patterns are anchored at the watcher path */
+      pattern = patterns[i];
+      while (*pattern == G_DIR_SEPARATOR)
+        pattern++;
+
+      len = strlen(pattern);
+      if (len == 0)
+        continue;
+
+      if (pattern[len - 1] != G_DIR_SEPARATOR)
+        {
+          pattern_set_add(set, pattern, strstr(pattern, "**") != NULL);
+
+          continue;
+        }
+
+      while ((len > 0) && (pattern[len - 1] == G_DIR_SEPARATOR))
+        len--;
+
+      dir = g_strndup(pattern, len);
+      content = g_strconcat(dir, G_DIR_SEPARATOR_S "**", NULL);
+
+      pattern_set_add(set, dir, TRUE);
+      pattern_set_add(set, content, TRUE);
+
+      g_free(content);
+      g_free(dir);
+    }
+
+  return set;
+}
+
+void
+pattern_set_free(pattern_set_t *set)
+{
+  guint i;
+
+  if (!set)
+    return;
+
+  if (set->literals)
+    g_hash_table_destroy(set->literals);
+  if (set->prefixes)
+    g_hash_table_destroy(set->prefixes);
+  if (set->suffixes)
+    g_hash_table_destroy(set->suffixes);
+
+  for (i = 0; i < set->n_specs; i++)
+    g_pattern_spec_free(set->specs[i]);
+
+  for (i = 0; i < set->n_globs; i++)
+    g_free(set->globs[i]);
+
+  g_free(set->specs);
+  g_free(set->globs);
+  g_free(set);
+}
+
+gboolean
+pattern_set_match(const pattern_set_t *set, const gchar *file)
+{
+  gchar *prefix;
+  gsize len, i;
+  gboolean found;
+
+  if (set->any)
+    return TRUE;
+
+  len = strlen(file);
+
+  if (set->literals && g_hash_table_lookup(set->literals, file))
+    return TRUE;
+
+  if (set->suffixes)
+    {
+      for (i = (len > set->max_suffix) ? len - set->max_suffix : 0; i < len;
+          i++)
+        {
+          if (g_hash_table_lookup(set->suffixes, file + i))
+            return TRUE;
+        }
+    }
+
+  if (set->prefixes)
+    {
+      found = FALSE;
+      prefix = g_strndup(file, MIN(len, set->max_prefix));
+
+      for (i = strlen(prefix); (i > 0) && !found; i--)
+        {
+          prefix[i] = '\0';
+
+          found = g_hash_table_lookup(set->prefixes, prefix) != NULL;
+        }
+
+      g_free(prefix);
+
+      if (found)
+        return TRUE;
+    }
+
+  for (i = 0; i < set->n_specs; i++)
+    {
+      if (g_pattern_match(set->specs[i], len, file, NULL))
+        return TRUE;
+    }
+
+  for (i = 0; i < set->n_globs; i++)
+    {
+      if (pattern_glob_match(set->globs[i], file))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/*
+ * Compiles a list of regular expressions separated by commas into a single
+ * alternation. The commas inside brackets, braces or escaped by a backslash
+ * belong to the expressions.
+ */
+GRegex *
+pattern_regex_new(const gchar *list, GError **error)
+{
+  GRegex *regex;
+  GString *alternation;
+  const gchar *p, *start;
+  gint brackets = 0, braces = 0;
+
+  alternation = g_string_new(NULL);
+
+  for (p = start = list;; p++)
+    {
+      if ((*p == '\\') && (p[1] != '\0'))
+        {
+          p++;
+
+          continue;
+        }
+
+      if (*p == '[')
+        brackets++;
+      else if ((*p == ']') && (brackets > 0))
+        brackets--;
+      else if ((*p == '{') && (brackets == 0))
+        braces++;
+      else if ((*p == '}') && (braces > 0))
+        braces--;
+
+      if ((*p == '\0') || ((*p == ',') && (brackets == 0) && (braces == 0)))
+        {
+          if (p > start)
+            {
+              if (alternation->len > 0)
+                g_string_append_c(alternation, '|');
+
+              g_string_append(alternation, "(?:");
+              g_string_append_len(alternation, start, p - start);
+              g_string_append_c(alternation, ')');
+            }
+
+          if (*p == '\0')
+            break;
+
+          start = p + 1;
+        }
+    }
+
+  if (alternation->len == 0)
+    {
+      g_string_free(alternation, TRUE);
+
+      return NULL;
+    }
+
+  regex = g_regex_new(alternation->str, G_REGEX_OPTIMIZE, 0, error);
+
+  g_string_free(alternation, TRUE);
+
+  return regex;
+}
@@ -0,0 +1,49 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef PATTERN_H_
+#define PATTERN_H_
+
+#include "common.h"
+
+typedef struct _pattern_set_t
+{
+  gboolean any;
+  GHashTable *literals;
+  GHashTable *prefixes;
+  gsize max_prefix;
+  GHashTable *suffixes;
+  gsize max_suffix;
+  GPatternSpec **specs;
+  guint n_specs;
+  gchar **globs;
+  guint n_globs;
+} pattern_set_t;
+
+pattern_set_t *
+pattern_set_new(gchar **patterns);
+void
+pattern_set_free(pattern_set_t *set);
+gboolean
+pattern_set_match(const pattern_set_t *set, const gchar *file);
+GRegex *
+pattern_regex_new(const gchar *list, GError **error);
+
+#endif /* PATTERN_H_ */
@@ -0,0 +1,177 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "pattern.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PATTERN_TEST_MATCHES    200000
+#define PATTERN_TEST_RUNS       5
+#define PATTERN_TEST_RATIO      4
+
+/*
+ * Checks the semantics of the pattern sets, then measures a match against
+ * sets of growing size: the literal, prefix and suffix patterns are looked up
+ * in hash sets, so the cost of a match must not depend on their number.
+ */
+
+static gboolean
+pattern_test_match(const gchar *pattern, const gchar *file)
+{
+  pattern_set_t *set;
+  gchar *patterns[2];
+  gboolean match;
+
+  patterns[0] = (gchar *) pattern;
+  patterns[1] = NULL;
+
+  set = pattern_set_new(patterns);
+  match = pattern_set_match(set, file);
+  pattern_set_free(set);
+
+  return match;
+}
+
+static void
+pattern_test_check(const gchar *pattern, const gchar *file, gboolean expected)
+{
+  if (pattern_test_match(pattern, file) == expected)
+    return;
+
+  fprintf(stderr, "pattern '%s' %s '%s'\n", pattern,
+      expected ? "does not match" : "matches", file);
+
+  exit(EXIT_FAILURE);
+}
+
+static void
+pattern_test_semantics(void)
+{
+  /* plain patterns */
+  pattern_test_check("foo", "foo", TRUE);
+  pattern_test_check("foo", "a/foo", FALSE);
+  pattern_test_check("*", "x", TRUE);
+  pattern_test_check("*.c", "a/b.c", TRUE);
+  pattern_test_check("*.c", "a/b.h", FALSE);
+  pattern_test_check("logs/*", "logs/a/b", TRUE);
+  pattern_test_check("logs/*", "log", FALSE);
+  pattern_test_check("a*b?c", "axxbyc", TRUE);
+  pattern_test_check("a*b?c", "axxbc", FALSE);
+  pattern_test_check("src/*.c", "src/x/a.c", TRUE);
+
+  /* "**" matches any number of directories */
+  pattern_test_check("**", "a/b", TRUE);
+  pattern_test_check("**/foo", "foo", TRUE);
+  pattern_test_check("**/foo", "a/b/foo", TRUE);
+  pattern_test_check("**/foo", "a/xfoo", FALSE);
+  pattern_test_check("**/*.o", "x.o", TRUE);
+  pattern_test_check("**/*.o", "a/b/x.o", TRUE);
+  pattern_test_check("**/*.o", "a/b/x.oo", FALSE);
+  pattern_test_check("src/**/*.c", "src/a.c", TRUE);
+  pattern_test_check("src/**/*.c", "src/x/y/a.c", TRUE);
+  pattern_test_check("src/**/*.c", "src/x/y/a.h", FALSE);
+  pattern_test_check("a/**", "a/", TRUE);
+
+  /* "dir/" matches a directory and all its content */
+  pattern_test_check("build/", "build", TRUE);
+  pattern_test_check("build/", "build/x/y", TRUE);
+  pattern_test_check("build/", "buildx", FALSE);
+  pattern_test_check("**/test_*/", "a/test_1", TRUE);
+  pattern_test_check("**/test_*/", "a/test_1/b/c", TRUE);
+  pattern_test_check("**/test_*/", "a/tst_1/b", FALSE);
+
+  /* the path patterns are anchored at the watcher path */
+  pattern_test_check("build/", "xbuild/y", FALSE);
+  pattern_test_check("build/", "a/build/y", FALSE);
+  pattern_test_check("/build/", "build/x", TRUE);
+  pattern_test_check("/top", "top", TRUE);
+}
+
+static gint64
+pattern_test_time(guint count)
+{
+  pattern_set_t *set;
+  gchar **patterns;
+  gint64 start, best = G_MAXINT64;
+  guint i, run, hits = 0;
+
+  patterns = g_new0(gchar *, 3 * count + 1);
+  for (i = 0; i < count; i++)
+    {
+      patterns[3 * i] = g_strdup_printf("file%06u", i);
+      patterns[3 * i + 1] = g_strdup_printf("*.ext%06u", i);
+      patterns[3 * i + 2] = g_strdup_printf("dir%06u/*", i);
+    }
+
+  set = pattern_set_new(patterns);
+
+  /* the best run is kept to not measure the load of the host */
+  for (run = 0; run < PATTERN_TEST_RUNS; run++)
+    {
+      start = g_get_monotonic_time();
+
+      for (i = 0; i < PATTERN_TEST_MATCHES; i++)
+        hits += pattern_set_match(set, "some/dir/with/a/file.nomatch");
+
+      best = MIN(best, g_get_monotonic_time() - start);
+    }
+
+  pattern_set_free(set);
+  g_strfreev(patterns);
+
+  if (hits)
+    {
+      fprintf(stderr, "%u patterns matched an unknown file\n", 3 * count);
+
+      exit(EXIT_FAILURE);
+    }
+
+  printf("patterns=%u, time=%" G_GINT64_FORMAT "ns\n", 3 * count,
+      best * 1000 / PATTERN_TEST_MATCHES);
+
+  return best;
+}
+
+static void
+pattern_test_cost(void)
+{
+  gint64 small, large;
+
+  small = pattern_test_time(1);
+  pattern_test_time(100);
+  large = pattern_test_time(10000);
+
+  if (large > small * PATTERN_TEST_RATIO)
+    {
+      fprintf(stderr, "%s\n", "the cost of a match depends on the patterns");
+
+      exit(EXIT_FAILURE);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+  pattern_test_semantics();
+  pattern_test_cost();
+
+  return EXIT_SUCCESS;
+}
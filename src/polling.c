@@ -0,0 +1,343 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "fmon.h"
+#include "monitor_inotify.h"
+#include "polling.h"
+#include "statcache.h"
+#include "tree.h"
+#include "watcher.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+
+/*
+ * The directories beyond the inotify watch budget are polled: each one keeps
+ * a snapshot of its entries, compared at a low rate to report the created,
+ * deleted and changed entries. A pass runs from the main loop in slices, and a
+ * polled directory gets back an inotify watch as soon as the budget allows it.
+ */
+
+typedef struct _polling_event_t
+{
+  gchar *file;
+  GFileMonitorEvent event_type;
+} polling_event_t;
+
+static gboolean
+polling_timeout(gpointer user_data);
+
+static GHashTable *
+polling_read(const gchar *path)
+{
+  GHashTable *entries;
+  polling_entry_t *entry;
+  struct dirent *dirent;
+  struct stat st;
+  DIR *dir;
+
+  dir = opendir(path);
+  if (!dir)
+    return NULL;
+
+  entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+  while ((dirent = readdir(dir)) != NULL)
+    {
+      if ((dirent->d_name[0] == '.') && ((dirent->d_name[1] == '\0')
+          || ((dirent->d_name[1] == '.') && (dirent->d_name[2] == '\0'))))
+        continue;
+
+      if (fstatat(dirfd(dir), dirent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+        continue;
+
+      entry = g_new(polling_entry_t, 1);
+      entry->mtime = (gint64) st.st_mtim.tv_sec * 1000000000
+          + st.st_mtim.tv_nsec;
+      entry->ctime = (gint64) st.st_ctim.tv_sec * 1000000000
+          + st.st_ctim.tv_nsec;
+      entry->size = (gint64) st.st_size;
+      entry->dir = S_ISDIR(st.st_mode);
+
+      g_hash_table_insert(entries, g_strdup(dirent->d_name), entry);
+    }
+
+  closedir(dir);
+
+  return entries;
+}
+
+static void
+polling_event_add(GArray *events, const gchar *path, const gchar *name,
+    GFileMonitorEvent event_type)
+{
+  polling_event_t event;
+
+  event.file = g_build_path(G_DIR_SEPARATOR_S, path, name, NULL);
+  event.event_type = event_type;
+
+  g_array_append_val(events, event);
+}
+
+static void
+polling_scan(watcher_t *watcher, polling_dir_t *poll)
+{
+  GHashTable *entries;
+  GHashTableIter iter;
+  GArray *events;
+  polling_event_t *event;
+  polling_entry_t *entry, *previous;
+  tree_node_t *node;
+  gpointer key, value, watch = NULL;
+  gchar *path;
+  guint i;
+#ifdef OS_LINUX
+  monitor_inotify_t *inotify;
+#endif
+
+  node = poll->node;
+  path = tree_node_get_path(node);
+
+#ifdef OS_LINUX
+  /* once the budget allows it, the directory is watched again before its
+   * last read, so an entry created meanwhile is either read or reported */
+  inotify = app->inotify;
+  if (inotify && !inotify->exhausted && (!inotify->limit
+      || (g_hash_table_size(inotify->watches) < inotify->limit)))
+    watch = monitor_inotify_add_watch(node, path);
+#endif
+
+  /* a vanished directory is reported by its parent */
+  entries = polling_read(path);
+
+  events = g_array_new(FALSE, FALSE, sizeof(polling_event_t));
+
+  if (entries)
+    {
+      g_hash_table_iter_init(&iter, entries);
+      while (g_hash_table_iter_next(&iter, &key, &value))
+        {
+          entry = (polling_entry_t *) value;
+
+          previous = g_hash_table_lookup(poll->entries, key);
+          if (!previous || (previous->dir != entry->dir))
+            {
+              if (previous)
+                polling_event_add(events, path, key,
+                    G_FILE_MONITOR_EVENT_DELETED);
+
+              polling_event_add(events, path, key,
+                  G_FILE_MONITOR_EVENT_CREATED);
+            }
+          else if ((previous->mtime != entry->mtime)
+              || (previous->size != entry->size))
+            polling_event_add(events, path, key, G_FILE_MONITOR_EVENT_CHANGED);
+          else if (previous->ctime != entry->ctime)
+            polling_event_add(events, path, key,
+                G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED);
+        }
+
+      g_hash_table_iter_init(&iter, poll->entries);
+      while (g_hash_table_iter_next(&iter, &key, NULL))
+        {
+          if (!g_hash_table_contains(entries, key))
+            polling_event_add(events, path, key,
+                G_FILE_MONITOR_EVENT_DELETED);
+        }
+    }
+
+  if (watch)
+    {
+      polling_remove(watcher, node);
+      node->monitor = watch;
+
+      if (entries)
+        g_hash_table_destroy(entries);
+
+      LOG_DEBUG("%s: %s (path=%s)",
+          watcher->name, N_("inotify watch restored"), path);
+    }
+  else if (entries)
+    {
+      g_hash_table_destroy(poll->entries);
+      poll->entries = entries;
+    }
+
+  /* the events may change the index, the directory is left alone */
+  statcache_begin();
+
+  for (i = 0; i < events->len; i++)
+    {
+      event = &g_array_index(events, polling_event_t, i);
+
+      watcher_event_process(watcher, event->file, event->event_type);
+
+      g_free(event->file);
+    }
+
+  g_array_free(events, TRUE);
+  g_free(path);
+}
+
+static gboolean
+polling_idle(gpointer user_data)
+{
+  watcher_t *watcher;
+  GList *link;
+  guint i;
+
+  watcher = (watcher_t *) user_data;
+
+  for (i = 0; (i < POLLING_SLICE) && (watcher->poll_remaining > 0); i++)
+    {
+      watcher->poll_remaining--;
+
+      link = g_queue_pop_head_link(&watcher->polls);
+      if (!link)
+        break;
+
+      g_queue_push_tail_link(&watcher->polls, link);
+
+      polling_scan(watcher, (polling_dir_t *) link->data);
+    }
+
+  if (watcher->poll_remaining > 0)
+    return TRUE;
+
+  watcher->poll_passes++;
+
+  if (g_queue_is_empty(&watcher->polls))
+    {
+      watcher->poll_source = 0;
+
+      return FALSE;
+    }
+
+  watcher->poll_source = g_timeout_add_seconds(watcher->poll_interval,
+      polling_timeout, watcher);
+
+  return FALSE;
+}
+
+static gboolean
+polling_timeout(gpointer user_data)
+{
+  watcher_t *watcher;
+
+  watcher = (watcher_t *) user_data;
+
+  if (g_queue_is_empty(&watcher->polls))
+    {
+      watcher->poll_source = 0;
+
+      return FALSE;
+    }
+
+  watcher->poll_remaining = watcher->polls.length;
+  watcher->poll_source = g_idle_add(polling_idle, watcher);
+
+  return FALSE;
+}
+
+gboolean
+polling_add(watcher_t *watcher, tree_node_t *node, const gchar *path)
+{
+  polling_dir_t *poll;
+  GHashTable *entries;
+
+  entries = polling_read(path);
+  if (!entries)
+    {
+      LOG_ERROR("%s: %s (path=%s, %s)",
+          watcher->name, N_("failed to read polled directory"), path,
+          g_strerror(errno));
+
+      return FALSE;
+    }
+
+  poll = g_new0(polling_dir_t, 1);
+  poll->node = node;
+  poll->entries = entries;
+  poll->link.data = poll;
+
+  g_queue_push_tail_link(&watcher->polls, &poll->link);
+
+  node->monitor = poll;
+  node->polled = TRUE;
+
+  LOG_DEBUG("%s: %s (path=%s)", watcher->name, N_("directory polled"), path);
+
+  /* the sources stop by themselves once nothing is left to poll */
+  if (!watcher->poll_source)
+    watcher->poll_source = g_timeout_add_seconds(watcher->poll_interval,
+        polling_timeout, watcher);
+
+  return TRUE;
+}
+
+void
+polling_remove(watcher_t *watcher, tree_node_t *node)
+{
+  polling_dir_t *poll;
+
+  poll = (polling_dir_t *) node->monitor;
+
+  g_queue_unlink(&watcher->polls, &poll->link);
+
+  g_hash_table_destroy(poll->entries);
+  g_free(poll);
+
+  node->monitor = NULL;
+  node->polled = FALSE;
+}
+
+void
+polling_cancel(watcher_t *watcher)
+{
+  if (!watcher->poll_source)
+    return;
+
+  g_source_remove(watcher->poll_source);
+  watcher->poll_source = 0;
+  watcher->poll_remaining = 0;
+}
+
+static void
+polling_count(tree_node_t *node, gpointer user_data)
+{
+  if (node->monitor && !node->polled)
+    (*(guint *) user_data)++;
+}
+
+void
+polling_list(const watcher_t *watcher)
+{
+  guint watches = 0;
+
+  tree_foreach(&watcher->monitors->root, polling_count, &watches);
+
+  LOG_INFO("%s: %s (watches=%u, polled=%u, interval=%us, passes=%"
+      G_GUINT64_FORMAT ")",
+      watcher->name, N_("watch usage"), watches, watcher->polls.length,
+      watcher->poll_interval, watcher->poll_passes);
+}
@@ -0,0 +1,55 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef POLLING_H_
+#define POLLING_H_
+
+#include "common.h"
+
+struct _tree_node_t;
+struct _watcher_t;
+
+typedef struct _polling_entry_t
+{
+  gint64 mtime;
+  gint64 ctime;
+  gint64 size;
+  gboolean dir;
+} polling_entry_t;
+
+typedef struct _polling_dir_t
+{
+  struct _tree_node_t *node;
+  GHashTable *entries;
+  GList link;
+#define POLLING_SLICE                   64
+} polling_dir_t;
+
+gboolean
+polling_add(struct _watcher_t *watcher, struct _tree_node_t *node,
+    const gchar *path);
+void
+polling_remove(struct _watcher_t *watcher, struct _tree_node_t *node);
+void
+polling_cancel(struct _watcher_t *watcher);
+void
+polling_list(const struct _watcher_t *watcher);
+
+#endif /* POLLING_H_ */
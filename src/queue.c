@@ -0,0 +1,273 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "fmon.h"
+#include "queue.h"
+#include "rescan.h"
+#include "statcache.h"
+#include "watcher.h"
+#include "workers.h"
+
+/*
+ * The events received from the backends are stored in a ring of fixed size
+ * and delivered from an idle source, so a slow test or command never delays
+ * the reading of the kernel queue. The slots keep their buffer from one event
+ * to the next. When the ring is full, the policy of the watcher decides which
+ * events are lost. A busy persistent worker holds back the delivery until it
+ * has room again, so the ring fills and the policy applies.
+ */
+
+static const gchar *
+queue_get_policy_name(guint policy)
+{
+  switch (policy)
+  {
+  case QUEUE_POLICY_DROP_OLDEST:
+    return CONFIG_KEY_WATCHER_QUEUEPOLICY_DROPOLDEST;
+
+  case QUEUE_POLICY_DROP_NEWEST:
+    return CONFIG_KEY_WATCHER_QUEUEPOLICY_DROPNEWEST;
+
+  case QUEUE_POLICY_RESCAN:
+    return CONFIG_KEY_WATCHER_QUEUEPOLICY_RESCAN;
+
+  default:
+    return CONFIG_KEY_WATCHER_QUEUEPOLICY_BLOCK;
+  }
+}
+
+static queue_entry_t *
+queue_get_tail(queue_t *queue)
+{
+  return &queue->entries[(queue->head + queue->length) % queue->size];
+}
+
+static void
+queue_drop(queue_t *queue)
+{
+  queue->head = (queue->head + 1) % queue->size;
+  queue->length--;
+  queue->dropped++;
+}
+
+static void
+queue_pop(queue_t *queue)
+{
+  queue_entry_t *entry;
+
+  entry = &queue->entries[queue->head];
+
+  queue->head = (queue->head + 1) % queue->size;
+  queue->length--;
+  queue->dispatched++;
+
+  /* the slot is only reused by the next push, after the dispatch */
+  watcher_event_dispatch(queue->watcher, entry->file->str, entry->event_type);
+}
+
+static gboolean
+queue_idle(gpointer user_data)
+{
+  queue_t *queue;
+  guint i;
+
+  queue = (queue_t *) user_data;
+
+  statcache_begin();
+
+  for (i = 0; (i < QUEUE_SLICE) && (queue->length > 0); i++)
+    {
+      if (queue->watcher->workers
+          && workers_is_busy(queue->watcher->workers,
+              queue->entries[queue->head].file->str))
+        {
+          LOG_DEBUG("%s: %s (length=%u)",
+              queue->watcher->name, N_("event queue held by a busy worker"),
+              queue->length);
+
+          queue->source = 0;
+          queue->held = TRUE;
+
+          return FALSE;
+        }
+
+      queue_pop(queue);
+    }
+
+  if (queue->length > 0)
+    return TRUE;
+
+  queue->source = 0;
+  queue->overloaded = FALSE;
+
+  return FALSE;
+}
+
+queue_t *
+queue_new(watcher_t *watcher, guint size, guint policy)
+{
+  queue_t *queue;
+  guint i;
+
+  queue = g_new0(queue_t, 1);
+  queue->watcher = watcher;
+  queue->policy = policy;
+  queue->size = size;
+  queue->entries = g_new0(queue_entry_t, size);
+
+  for (i = 0; i < size; i++)
+    queue->entries[i].file = g_string_new(NULL);
+
+  return queue;
+}
+
+void
+queue_free(queue_t *queue)
+{
+  guint i;
+
+  if (!queue)
+    return;
+
+  queue_flush(queue);
+
+  for (i = 0; i < queue->size; i++)
+    g_string_free(queue->entries[i].file, TRUE);
+
+  g_free(queue->entries);
+  g_free(queue);
+}
+
+void
+queue_push(queue_t *queue, const gchar *file, GFileMonitorEvent event_type)
+{
+  queue_entry_t *entry;
+
+  queue->pushed++;
+
+  if (queue->length == queue->size)
+    {
+      if (!queue->overloaded)
+        {
+          LOG_ERROR("%s: %s (size=%u, policy=%s)",
+              queue->watcher->name, N_("event queue full"), queue->size,
+              queue_get_policy_name(queue->policy));
+
+          queue->overloaded = TRUE;
+        }
+
+      switch (queue->policy)
+      {
+      case QUEUE_POLICY_DROP_OLDEST:
+        {
+          queue_drop(queue);
+
+          break;
+        }
+
+      case QUEUE_POLICY_DROP_NEWEST:
+        {
+          queue->dropped++;
+
+          LOG_DEBUG("%s: %s (event_type=%d, file=%s)",
+              queue->watcher->name, N_("event dropped"), event_type, file);
+
+          return;
+        }
+
+      case QUEUE_POLICY_RESCAN:
+        {
+          /* the pending events and this one are replaced by a rescan */
+          queue->dropped += queue->length + 1;
+          queue->collapsed++;
+          queue->head = 0;
+          queue->length = 0;
+
+          rescan_request(queue->watcher);
+
+          return;
+        }
+
+      default:
+        {
+          /* the reader waits for the oldest event to be delivered, a busy
+           * worker keeps it in its pending queue */
+          queue->blocked++;
+
+          queue_pop(queue);
+
+          break;
+        }
+      }
+    }
+
+  entry = queue_get_tail(queue);
+  g_string_assign(entry->file, file);
+  entry->event_type = event_type;
+
+  queue->length++;
+  if (queue->length > queue->max_length)
+    queue->max_length = queue->length;
+
+  if (!queue->source && !queue->held)
+    queue->source = g_idle_add(queue_idle, queue);
+}
+
+void
+queue_resume(queue_t *queue)
+{
+  if (!queue->held)
+    return;
+
+  queue->held = FALSE;
+
+  if (!queue->source && (queue->length > 0))
+    queue->source = g_idle_add(queue_idle, queue);
+}
+
+void
+queue_flush(queue_t *queue)
+{
+  if (queue->source)
+    {
+      g_source_remove(queue->source);
+      queue->source = 0;
+    }
+
+  statcache_begin();
+
+  while (queue->length > 0)
+    queue_pop(queue);
+
+  queue->overloaded = FALSE;
+  queue->held = FALSE;
+}
+
+void
+queue_list(const queue_t *queue)
+{
+  LOG_INFO("%s: %s (length=%u, size=%u, max=%u, policy=%s, pushed=%"
+      G_GUINT64_FORMAT ", dispatched=%" G_GUINT64_FORMAT ", dropped=%"
+      G_GUINT64_FORMAT ", blocked=%" G_GUINT64_FORMAT ", collapsed=%"
+      G_GUINT64_FORMAT ")",
+      queue->watcher->name, N_("event queue"), queue->length, queue->size,
+      queue->max_length, queue_get_policy_name(queue->policy), queue->pushed,
+      queue->dispatched, queue->dropped, queue->blocked, queue->collapsed);
+}
@@ -0,0 +1,71 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef QUEUE_H_
+#define QUEUE_H_
+
+#include "common.h"
+
+struct _watcher_t;
+
+typedef struct _queue_entry_t
+{
+  GString *file;
+  GFileMonitorEvent event_type;
+} queue_entry_t;
+
+typedef struct _queue_t
+{
+  struct _watcher_t *watcher;
+  guint policy;
+#define QUEUE_POLICY_BLOCK              0
+#define QUEUE_POLICY_DROP_OLDEST        1
+#define QUEUE_POLICY_DROP_NEWEST        2
+#define QUEUE_POLICY_RESCAN             3
+#define QUEUE_SLICE                     256
+  queue_entry_t *entries;
+  guint size;
+  guint head;
+  guint length;
+  guint source;
+  gboolean overloaded;
+  gboolean held;
+  guint max_length;
+  guint64 pushed;
+  guint64 dispatched;
+  guint64 dropped;
+  guint64 blocked;
+  guint64 collapsed;
+} queue_t;
+
+queue_t *
+queue_new(struct _watcher_t *watcher, guint size, guint policy);
+void
+queue_free(queue_t *queue);
+void
+queue_push(queue_t *queue, const gchar *file, GFileMonitorEvent event_type);
+void
+queue_flush(queue_t *queue);
+void
+queue_resume(queue_t *queue);
+void
+queue_list(const queue_t *queue);
+
+#endif /* QUEUE_H_ */
@@ -0,0 +1,245 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "fmon.h"
+#include "crawler.h"
+#include "rescan.h"
+#include "statcache.h"
+#include "tree.h"
+#include "watcher.h"
+
+/*
+ * Once events were lost, the directories found on disk are compared with the
+ * monitor index. The topmost directories missing from either side get a
+ * synthetic created or deleted event, whose processing attaches or releases
+ * the monitors of their whole subtree. The changes of the files themselves
+ * cannot be recovered, so a changed event on the watcher path closes the
+ * rescan. Requests made while a rescan is pending are merged, and two rescans
+ * are separated by a minimum interval.
+ */
+
+static gboolean
+rescan_timeout(gpointer user_data)
+{
+  watcher_t *watcher;
+
+  watcher = (watcher_t *) user_data;
+  watcher->rescan_source = 0;
+
+  rescan_run(watcher);
+
+  return FALSE;
+}
+
+static gboolean
+rescan_prune(const gchar *path, gpointer user_data)
+{
+  return watcher_is_pruned((const watcher_t *) user_data, path);
+}
+
+static gboolean
+rescan_collect(const gchar *path, guint depth, gpointer user_data)
+{
+  g_hash_table_add((GHashTable *) user_data, g_strdup(path));
+
+  return TRUE;
+}
+
+static void
+rescan_collect_node(tree_node_t *node, gpointer user_data)
+{
+  g_ptr_array_add((GPtrArray *) user_data, tree_node_get_path(node));
+}
+
+static gboolean
+rescan_is_topmost(const watcher_t *watcher, const gchar *path,
+    GHashTable *dirs)
+{
+  tree_node_t *node;
+  gchar *parent;
+  gboolean ret;
+
+  parent = g_path_get_dirname(path);
+
+  /* a vanished directory is reported if its parent is still there, a new
+   * one if its parent is already monitored */
+  if (dirs)
+    ret = g_hash_table_contains(dirs, parent);
+  else
+    {
+      node = tree_lookup(watcher->monitors, parent);
+      ret = (node && node->monitor);
+    }
+
+  g_free(parent);
+
+  return ret;
+}
+
+static void
+rescan_diff(watcher_t *watcher)
+{
+  GHashTable *dirs;
+  GHashTableIter iter;
+  GPtrArray *nodes, *created;
+  tree_node_t *node;
+  gpointer key;
+  const gchar *path;
+  guint i, n_created = 0, n_deleted = 0, n_attached = 0;
+
+  dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  if (watcher->recursive)
+    crawler_run(watcher->path, 1, watcher->maxdepth, watcher->mount,
+        app->crawler_threads, rescan_prune, rescan_collect, NULL, dirs);
+  else if (g_file_test(watcher->path, G_FILE_TEST_IS_DIR))
+    g_hash_table_add(dirs, g_strdup(watcher->path));
+
+  /* the events below change the index, so it is copied first */
+  nodes = g_ptr_array_new_with_free_func(g_free);
+  tree_foreach(&watcher->monitors->root, rescan_collect_node, nodes);
+
+  for (i = 0; i < nodes->len; i++)
+    {
+      path = (const gchar *) g_ptr_array_index(nodes, i);
+
+      if (g_hash_table_contains(dirs, path)
+          || (g_strcmp0(path, watcher->path) == 0)
+          || !rescan_is_topmost(watcher, path, dirs))
+        continue;
+
+      LOG_DEBUG("%s: %s (path=%s)",
+          watcher->name, N_("directory deleted during overflow"), path);
+
+      watcher_event_process(watcher, path, G_FILE_MONITOR_EVENT_DELETED);
+      n_deleted++;
+    }
+
+  g_ptr_array_free(nodes, TRUE);
+
+  created = g_ptr_array_new();
+
+  g_hash_table_iter_init(&iter, dirs);
+  while (g_hash_table_iter_next(&iter, &key, NULL))
+    {
+      path = (const gchar *) key;
+
+      node = tree_lookup(watcher->monitors, path);
+      if (node && node->monitor)
+        continue;
+
+      /* a known directory has only lost its monitor */
+      if (node || (g_strcmp0(path, watcher->path) == 0))
+        {
+          if (watcher_add_monitor_for_path(watcher, path))
+            n_attached++;
+
+          continue;
+        }
+
+      if (rescan_is_topmost(watcher, path, NULL))
+        g_ptr_array_add(created, key);
+    }
+
+  for (i = 0; i < created->len; i++)
+    {
+      path = (const gchar *) g_ptr_array_index(created, i);
+
+      LOG_DEBUG("%s: %s (path=%s)",
+          watcher->name, N_("directory created during overflow"), path);
+
+      watcher_event_process(watcher, path, G_FILE_MONITOR_EVENT_CREATED);
+      n_created++;
+    }
+
+  g_ptr_array_free(created, TRUE);
+  g_hash_table_destroy(dirs);
+
+  LOG_INFO("%s: %s (created=%u, deleted=%u, attached=%u)",
+      watcher->name, N_("monitor index reconciled"), n_created, n_deleted,
+      n_attached);
+}
+
+void
+rescan_request(watcher_t *watcher)
+{
+  gint64 now, delay;
+
+  watcher->rescan_requests++;
+
+  if (watcher->rescan_source)
+    {
+      LOG_DEBUG("%s: %s", watcher->name, N_("rescan already scheduled"));
+
+      return;
+    }
+
+  /* the burst is given some time to end, and the rescans some rest */
+  now = g_get_monotonic_time() / 1000;
+  delay = WATCHER_RESCAN_DELAY;
+  if (watcher->rescan_time
+      && (watcher->rescan_time + WATCHER_RESCAN_INTERVAL > now + delay))
+    delay = watcher->rescan_time + WATCHER_RESCAN_INTERVAL - now;
+
+  LOG_INFO("%s: %s (delay=%" G_GINT64_FORMAT "ms)",
+      watcher->name, N_("rescan scheduled"), delay);
+
+  watcher->rescan_source = g_timeout_add((guint) delay, rescan_timeout,
+      watcher);
+}
+
+void
+rescan_cancel(watcher_t *watcher)
+{
+  if (!watcher->rescan_source)
+    return;
+
+  g_source_remove(watcher->rescan_source);
+  watcher->rescan_source = 0;
+}
+
+void
+rescan_run(watcher_t *watcher)
+{
+  rescan_cancel(watcher);
+
+  LOG_INFO("%s: %s", watcher->name, N_("rescanning watcher path"));
+
+  watcher->rescan_time = g_get_monotonic_time() / 1000;
+  watcher->rescans++;
+
+  statcache_begin();
+
+  /* fanotify marks the whole filesystem and keeps no index */
+  if (watcher->backend != WATCHER_BACKEND_FANOTIFY)
+    rescan_diff(watcher);
+
+  watcher_event_process(watcher, watcher->path,
+      G_FILE_MONITOR_EVENT_CHANGED);
+}
+
+void
+rescan_list(const watcher_t *watcher)
+{
+  LOG_INFO("%s: %s (requests=%" G_GUINT64_FORMAT ", rescans=%"
+      G_GUINT64_FORMAT ", pending=%s)",
+      watcher->name, N_("rescans"), watcher->rescan_requests,
+      watcher->rescans, watcher->rescan_source ? "yes" : "no");
+}
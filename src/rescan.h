@@ -0,0 +1,37 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef RESCAN_H_
+#define RESCAN_H_
+
+#include "common.h"
+
+struct _watcher_t;
+
+void
+rescan_request(struct _watcher_t *watcher);
+void
+rescan_cancel(struct _watcher_t *watcher);
+void
+rescan_run(struct _watcher_t *watcher);
+void
+rescan_list(const struct _watcher_t *watcher);
+
+#endif /* RESCAN_H_ */
@@ -0,0 +1,133 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "fmon.h"
+#include "statcache.h"
+
+#include <errno.h>
+#include <string.h>
+
+/*
+ * The stat results of the files are shared by all the watchers receiving the
+ * events of a same batch read from a backend. A result is only valid for the
+ * batch it was taken in, except the failures on vanished files which are kept
+ * for STATCACHE_NEGATIVE_TTL milliseconds unless the file is created again.
+ */
+
+typedef struct _statcache_entry_t
+{
+  struct stat st;
+  gint error;
+  guint generation;
+  gint64 expires;
+} statcache_entry_t;
+
+static GHashTable *statcache_entries = NULL;
+static guint statcache_generation = 0;
+
+static gboolean
+statcache_is_stale(gpointer key, gpointer value, gpointer user_data)
+{
+  statcache_entry_t *entry;
+  gint64 now;
+
+  entry = (statcache_entry_t *) value;
+  now = *(gint64 *) user_data;
+
+  if (entry->error == ENOENT)
+    return now >= entry->expires;
+
+  return TRUE;
+}
+
+void
+statcache_begin(void)
+{
+  gint64 now;
+
+  statcache_generation++;
+
+  if (!statcache_entries || (g_hash_table_size(statcache_entries) == 0))
+    return;
+
+  now = g_get_monotonic_time();
+
+  g_hash_table_foreach_remove(statcache_entries, statcache_is_stale, &now);
+}
+
+gint
+statcache_stat(const gchar *file, struct stat *st)
+{
+  statcache_entry_t *entry;
+
+  if (!statcache_entries)
+    statcache_entries = g_hash_table_new_full(g_str_hash, g_str_equal,
+        g_free, g_free);
+
+  entry = g_hash_table_lookup(statcache_entries, file);
+  if (entry)
+    {
+      if (entry->error == ENOENT)
+        {
+          if (g_get_monotonic_time() < entry->expires)
+            return ENOENT;
+        }
+      else if (entry->generation == statcache_generation)
+        {
+          if (entry->error == 0)
+            memcpy(st, &entry->st, sizeof(struct stat));
+
+          return entry->error;
+        }
+    }
+  else
+    {
+      entry = g_new0(statcache_entry_t, 1);
+
+      g_hash_table_insert(statcache_entries, g_strdup(file), entry);
+    }
+
+  entry->generation = statcache_generation;
+  entry->error = (g_stat(file, &entry->st) == 0) ? 0 : errno;
+  entry->expires = (entry->error == ENOENT)
+      ? g_get_monotonic_time() + STATCACHE_NEGATIVE_TTL * 1000 : 0;
+
+  if (entry->error == 0)
+    memcpy(st, &entry->st, sizeof(struct stat));
+
+  return entry->error;
+}
+
+void
+statcache_forget(const gchar *file)
+{
+  if (statcache_entries)
+    g_hash_table_remove(statcache_entries, file);
+}
+
+void
+statcache_clear(void)
+{
+  if (!statcache_entries)
+    return;
+
+  g_hash_table_destroy(statcache_entries);
+  statcache_entries = NULL;
+}
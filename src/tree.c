@@ -0,0 +1,317 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "fmon.h"
+#include "tree.h"
+
+#include <string.h>
+
+/*
+ * The tree indexes the monitored directories of a watcher by path component.
+ * Each node only stores its own name, the children of all nodes are reachable
+ * through a single hash table keyed by (parent, name), so looking up a path
+ * costs one hash probe per component and removing a subtree only visits the
+ * nodes below it.
+ */
+
+static guint
+tree_node_hash(gconstpointer key)
+{
+  const tree_node_t *node = (const tree_node_t *) key;
+
+  return g_str_hash(node->name) ^ g_direct_hash(node->parent);
+}
+
+static gboolean
+tree_node_equal(gconstpointer a, gconstpointer b)
+{
+  const tree_node_t *node_a = (const tree_node_t *) a;
+  const tree_node_t *node_b = (const tree_node_t *) b;
+
+  return (node_a->parent == node_b->parent)
+      && (strcmp(node_a->name, node_b->name) == 0);
+}
+
+static tree_node_t *
+tree_node_new(tree_node_t *parent, const gchar *name, gsize len)
+{
+  tree_node_t *node;
+
+  /* the name is stored in the same block as the node */
+  node = (tree_node_t *) g_malloc0(sizeof(tree_node_t) + len + 1);
+  node->name = (gchar *) (node + 1);
+  memcpy(node->name, name, len);
+  node->name[len] = '\0';
+
+  node->parent = parent;
+  node->depth = parent->depth + 1;
+  node->next = parent->children;
+  if (parent->children)
+    parent->children->prev = node;
+  parent->children = node;
+
+  return node;
+}
+
+tree_t *
+tree_new(const gchar *path, gpointer data)
+{
+  tree_t *tree;
+
+  tree = g_new0(tree_t, 1);
+  tree->root.name = g_strdup(path);
+  tree->nodes = g_hash_table_new(tree_node_hash, tree_node_equal);
+  tree->data = data;
+
+  return tree;
+}
+
+void
+tree_free(tree_t *tree)
+{
+  if (!tree)
+    return;
+
+  while (tree->root.children)
+    tree_remove(tree, tree->root.children);
+
+  g_hash_table_destroy(tree->nodes);
+  g_free(tree->root.name);
+  g_free(tree);
+}
+
+tree_t *
+tree_node_get_tree(tree_node_t *node)
+{
+  while (node->parent)
+    node = node->parent;
+
+  return (tree_t *) node;
+}
+
+void
+tree_node_append_path(tree_node_t *node, const gchar *name, GString *buffer)
+{
+  tree_node_t *item;
+  gsize len, size, start;
+  gchar *path, *ptr;
+
+  size = name ? strlen(name) + 1 : 0;
+  for (item = node; item; item = item->parent)
+    size += strlen(item->name) + 1;
+
+  start = buffer->len;
+  g_string_set_size(buffer, start + size - 1);
+  path = buffer->str + start;
+  ptr = path + size - 1;
+
+  if (name)
+    {
+      len = strlen(name);
+      ptr -= len;
+      memcpy(ptr, name, len);
+    }
+
+  for (item = node; item; item = item->parent)
+    {
+      if (ptr != path + size - 1)
+        {
+          /* the root path may already end with a separator */
+          if (item->parent || (item->name[strlen(item->name) - 1]
+              != G_DIR_SEPARATOR))
+            *--ptr = G_DIR_SEPARATOR;
+        }
+
+      len = strlen(item->name);
+      ptr -= len;
+      memcpy(ptr, item->name, len);
+    }
+
+  if (ptr != path)
+    {
+      len = strlen(ptr);
+      memmove(path, ptr, len + 1);
+      g_string_set_size(buffer, start + len);
+    }
+}
+
+gchar *
+tree_node_build_path(tree_node_t *node, const gchar *name)
+{
+  GString *path;
+
+  path = g_string_sized_new(64);
+  tree_node_append_path(node, name, path);
+
+  return g_string_free(path, FALSE);
+}
+
+gchar *
+tree_node_get_path(tree_node_t *node)
+{
+  return tree_node_build_path(node, NULL);
+}
+
+static const gchar *
+tree_get_relative_path(tree_t *tree, const gchar *path)
+{
+  gsize len;
+
+  len = strlen(tree->root.name);
+  if (strncmp(path, tree->root.name, len) != 0)
+    return NULL;
+
+  if (path[len] == '\0')
+    return path + len;
+
+  if ((len > 0) && (tree->root.name[len - 1] == G_DIR_SEPARATOR))
+    return path + len;
+
+  if (path[len] == G_DIR_SEPARATOR)
+    return path + len + 1;
+
+  return NULL;
+}
+
+static tree_node_t *
+tree_walk(tree_t *tree, const gchar *path, gboolean create)
+{
+  tree_node_t *node, *child, key;
+  const gchar *rpath, *end;
+  gchar name[256];
+  gsize len;
+
+  rpath = tree_get_relative_path(tree, path);
+  if (!rpath)
+    return NULL;
+
+  node = &tree->root;
+
+  while (*rpath)
+    {
+      end = strchr(rpath, G_DIR_SEPARATOR);
+      len = end ? (gsize) (end - rpath) : strlen(rpath);
+
+      if ((len > 0) && (len < sizeof(name)))
+        {
+          memcpy(name, rpath, len);
+          name[len] = '\0';
+
+          key.parent = node;
+          key.name = name;
+
+          child = g_hash_table_lookup(tree->nodes, &key);
+          if (!child)
+            {
+              if (!create)
+                return NULL;
+
+              child = tree_node_new(node, name, len);
+              g_hash_table_insert(tree->nodes, child, child);
+            }
+
+          node = child;
+        }
+      else if (len > 0)
+        {
+          return NULL;
+        }
+
+      rpath += len;
+      if (*rpath == G_DIR_SEPARATOR)
+        rpath++;
+    }
+
+  return node;
+}
+
+tree_node_t *
+tree_lookup(tree_t *tree, const gchar *path)
+{
+  return tree_walk(tree, path, FALSE);
+}
+
+tree_node_t *
+tree_insert(tree_t *tree, const gchar *path)
+{
+  return tree_walk(tree, path, TRUE);
+}
+
+void
+tree_remove(tree_t *tree, tree_node_t *node)
+{
+  tree_node_t *child;
+
+  if (!node->parent)
+    {
+      while (node->children)
+        tree_remove(tree, node->children);
+
+      return;
+    }
+
+  while ((child = node->children) != NULL)
+    {
+      /* descend to a leaf before freeing to avoid deep recursion */
+      while (child->children)
+        child = child->children;
+
+      tree_remove(tree, child);
+    }
+
+  if (node->prev)
+    node->prev->next = node->next;
+  else
+    node->parent->children = node->next;
+
+  if (node->next)
+    node->next->prev = node->prev;
+
+  g_hash_table_remove(tree->nodes, node);
+  g_free(node);
+}
+
+void
+tree_foreach(tree_node_t *node, tree_func_t func, gpointer user_data)
+{
+  tree_node_t *item, *next;
+
+  item = node;
+
+  while (item)
+    {
+      /* the callback may not remove nodes, so the next node is known */
+      if (item->children)
+        next = item->children;
+      else
+        {
+          next = item;
+
+          while ((next != node) && !next->next)
+            next = next->parent;
+
+          next = (next != node) ? next->next : NULL;
+        }
+
+      func(item, user_data);
+
+      item = next;
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef TREE_H_
+#define TREE_H_
+
+#include "common.h"
+
+typedef struct _tree_node_t
+{
+  struct _tree_node_t *parent;
+  struct _tree_node_t *children;
+  struct _tree_node_t *prev;
+  struct _tree_node_t *next;
+  gpointer monitor;
+  gboolean polled;
+  guint depth;
+  gchar *name;
+} tree_node_t;
+
+typedef struct _tree_t
+{
+  tree_node_t root;
+  GHashTable *nodes;
+  gpointer data;
+} tree_t;
+
+typedef void
+(*tree_func_t)(tree_node_t *node, gpointer user_data);
+
+tree_t *
+tree_new(const gchar *path, gpointer data);
+void
+tree_free(tree_t *tree);
+tree_t *
+tree_node_get_tree(tree_node_t *node);
+gchar *
+tree_node_get_path(tree_node_t *node);
+void
+tree_node_append_path(tree_node_t *node, const gchar *name, GString *buffer);
+gchar *
+tree_node_build_path(tree_node_t *node, const gchar *name);
+tree_node_t *
+tree_lookup(tree_t *tree, const gchar *path);
+tree_node_t *
+tree_insert(tree_t *tree, const gchar *path);
+void
+tree_remove(tree_t *tree, tree_node_t *node);
+void
+tree_foreach(tree_node_t *node, tree_func_t func, gpointer user_data);
+
+#endif /* TREE_H_ */
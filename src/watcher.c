@@ -19,815 +19,726 @@
  */
 
 #include "fmon.h"
+#include "attach.h"
+#include "batch.h"
+#include "coalesce.h"
+#include "command.h"
+#include "crawler.h"
+#include "expr.h"
+#include "filter.h"
+#include "identity.h"
+#include "jobs.h"
+#include "monitor_fanotify.h"
+#include "monitor_inotify.h"
+#include "polling.h"
+#include "queue.h"
+#include "statcache.h"
+#include "tree.h"
 #include "watcher.h"
+#include "workers.h"
 
 #include <sys/types.h>
 #include <errno.h>
-#include <grp.h>
-#include <pwd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
-gboolean
-watcher_add_monitor_for_path(const watcher_t *watcher, const gchar *path)
+static void
+watcher_release_node(const watcher_t *watcher, tree_node_t *node)
 {
-  GFile *file;
-  GFileMonitor *monitor;
-  GError *error = NULL;
+  tree_node_t *parent;
 
-  LOG_DEBUG("%s: %s (path=%s)",
-      watcher->name, N_("creating file monitor for path"), path);
-
-  file = g_file_new_for_path(path);
-
-  monitor = g_file_monitor(file, G_FILE_MONITOR_NONE, NULL, &error);
-  g_object_unref(file);
-  if (error)
+  /* drop the node and its ancestors no longer holding a monitor */
+  while (node->parent && !node->monitor && !node->children)
     {
-      LOG_ERROR("%s: %s (path=%s)",
-          watcher->name, N_("failed to create file monitor"), error->message);
+      parent = node->parent;
 
-      g_error_free(error);
-      error = NULL;
+      tree_remove(watcher->monitors, node);
 
-      return FALSE;
+      node = parent;
     }
-
-  g_hash_table_insert(watcher->monitors, g_strdup(path), monitor);
-
-  g_signal_connect(monitor, "changed", G_CALLBACK(watcher_event),
-      (gpointer)watcher);
-
-  return TRUE;
 }
 
 gboolean
-watcher_add_monitor_for_recursive_path(const watcher_t *watcher,
-    const gchar *path, guint depth)
+watcher_add_monitor_for_path(const watcher_t *watcher, const gchar *path)
 {
   GFile *file;
-  GFileEnumerator *enumerator;
-  GFileInfo *info;
-  gchar *child_path;
+  GFileMonitor *monitor;
+  tree_node_t *node;
   GError *error = NULL;
 
-  if ((watcher->maxdepth > 0) && (depth > watcher->maxdepth))
+  LOG_DEBUG("%s: %s (path=%s)",
+      watcher->name, N_("creating file monitor for path"), path);
+
+#ifdef MONITOR_FANOTIFY_SUPPORTED
+  if (watcher->backend == WATCHER_BACKEND_FANOTIFY)
     {
-      LOG_DEBUG("%s: %s (depth=%d, path=%s)",
-          watcher->name, N_("maximum depth of recursion reached"), depth, path);
+      /* a single mark covers the filesystem holding the watcher path */
+      if (watcher->fanotify || (g_strcmp0(path, watcher->path) != 0))
+        return TRUE;
 
-      return TRUE;
+      return monitor_fanotify_create((watcher_t *) watcher);
     }
+#endif
 
-  if (!watcher_add_monitor_for_path(watcher, path))
-    return FALSE;
+  node = tree_insert(watcher->monitors, path);
+  if (!node)
+    {
+      LOG_ERROR("%s: %s (path=%s)",
+          watcher->name, N_("path outside of watcher path"), path);
 
-  file = g_file_new_for_path(path);
+      return FALSE;
+    }
 
-  enumerator = g_file_enumerate_children(file, "standard::type,standard::name",
-      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL, &error);
-  g_object_unref(file);
-  if (error)
+  if (node->monitor)
     {
-      LOG_ERROR("%s: %s (error=%s)",
-          watcher->name, N_("failed to create file enumerator"), error->message);
+      LOG_DEBUG("%s: %s (path=%s)",
+          watcher->name, N_("path already monitored"), path);
 
-      g_error_free(error);
-      error = NULL;
-
-      return FALSE;
+      return TRUE;
     }
 
-  while ((info = g_file_enumerator_next_file(enumerator, NULL, &error)) != NULL)
+#ifdef OS_LINUX
+  if (watcher->backend == WATCHER_BACKEND_INOTIFY)
     {
-      if (g_file_info_get_file_type(info) == G_FILE_TYPE_DIRECTORY)
-        {
-          child_path = g_build_path(G_DIR_SEPARATOR_S, path,
-              g_file_info_get_name(info), NULL);
+      if (monitor_inotify_admit())
+        node->monitor = monitor_inotify_add_watch(node, path);
 
-          if (!watcher_add_monitor_for_recursive_path(watcher, child_path,
-              depth + 1))
-            {
-              g_free(child_path);
-              g_object_unref(info);
-              g_object_unref(enumerator);
+      /* the directories beyond the watch budget are polled */
+      if (!node->monitor && app->inotify && app->inotify->exhausted
+          && polling_add((watcher_t *) watcher, node, path))
+        return TRUE;
 
-              return FALSE;
-            }
+      if (!node->monitor)
+        {
+          watcher_release_node(watcher, node);
 
-          g_free(child_path);
+          return FALSE;
         }
 
-      g_object_unref(info);
+      return TRUE;
     }
+#endif
+
+  file = g_file_new_for_path(path);
 
-  g_object_unref(enumerator);
+  monitor = g_file_monitor(file, G_FILE_MONITOR_NONE, NULL, &error);
+  g_object_unref(file);
   if (error)
     {
-      LOG_DEBUG("%s: %s (%s)",
-          watcher->name, N_("failed to iterate during file enumeration"), error->message);
+      LOG_ERROR("%s: %s (path=%s)",
+          watcher->name, N_("failed to create file monitor"), error->message);
 
       g_error_free(error);
       error = NULL;
 
+      watcher_release_node(watcher, node);
+
       return FALSE;
     }
 
+  node->monitor = monitor;
+
+  g_signal_connect(monitor, "changed", G_CALLBACK(watcher_event),
+      (gpointer)watcher);
+
   return TRUE;
 }
 
 void
-watcher_remove_monitor_for_path(const watcher_t *watcher, const gchar *path)
+watcher_free(watcher_t *watcher)
 {
-  GFileMonitor *w_monitor;
-  gchar *w_path;
-  GHashTableIter iter;
-  gpointer key, value;
+  gint i;
 
-  LOG_DEBUG("%s: %s (path=%s)",
-      watcher->name, N_("removing file monitor for path"), path);
+  if (!watcher)
+    return;
 
-  g_hash_table_iter_init(&iter, watcher->monitors);
-  while (g_hash_table_iter_next(&iter, &key, &value))
+  g_free(watcher->name);
+  g_free(watcher->path);
+  g_free(watcher->exec);
+  command_free(watcher->command);
+  g_free(watcher->type);
+  g_free(watcher->user);
+  g_free(watcher->group);
+  identity_free(watcher->users);
+  identity_free(watcher->groups);
+  g_strfreev(watcher->events);
+  g_strfreev(watcher->includes);
+  g_strfreev(watcher->excludes);
+  if (watcher->include_regex)
+    g_regex_unref(watcher->include_regex);
+  if (watcher->exclude_regex)
+    g_regex_unref(watcher->exclude_regex);
+  expr_free(watcher->expr);
+  filter_free(watcher->filter);
+  if (watcher->prunes)
     {
-      w_path = (gchar *) key;
-      w_monitor = (GFileMonitor *) value;
+      for (i = 0; watcher->prunes[i]; i++)
+        g_pattern_spec_free(watcher->prunes[i]);
 
-      if (g_strcmp0(w_path, path) == 0)
-        {
-          if (!g_file_monitor_is_cancelled(w_monitor))
-            {
-              g_file_monitor_cancel(w_monitor);
+      g_free(watcher->prunes);
+    }
+  tree_free(watcher->monitors);
+  g_free(watcher);
+}
 
-              LOG_DEBUG("%s: %s (%s)",
-                  watcher->name, N_("file monitor cancelled"), w_path);
-            }
-          else
-            {
-              LOG_DEBUG("%s: %s (%s)",
-                  watcher->name, N_("file monitor already cancelled"), w_path);
-            }
+const gchar *
+watcher_get_relative_path(const watcher_t *watcher, const gchar *file)
+{
+  gsize len;
 
-          g_hash_table_iter_remove(&iter);
+  len = strlen(watcher->path);
+  if (strncmp(file, watcher->path, len) != 0)
+    return NULL;
 
-          g_free(w_path);
-          g_object_unref(w_path);
+  if (file[len] == '\0')
+    return file + len;
 
-          break;
-        }
-    }
+  if (len == 1)
+    return file + 1;
+
+  if (file[len] == G_DIR_SEPARATOR)
+    return file + len + 1;
+
+  return NULL;
 }
 
-void
-watcher_remove_monitor_for_recursive_path(const watcher_t *watcher,
-    const gchar *path)
+guint
+watcher_get_depth(watcher_t *watcher, const gchar *file)
 {
-  GFile *w_file, *file;
-  GFileMonitor *w_monitor;
-  gchar *w_path;
-  GHashTableIter iter;
-  gpointer key, value;
+  tree_node_t *node;
+  const gchar *rfile;
+  guint depth = 1;
 
-  LOG_DEBUG("%s: %s (path=%s)",
-      watcher->name, N_("removing file monitors for recursive path"), path);
+  /* monitored directories already know their depth */
+  if (watcher->monitors)
+    {
+      node = tree_lookup(watcher->monitors, file);
+      if (node && node->parent)
+        return node->depth;
+    }
 
-  file = g_file_new_for_path(path);
+  rfile = watcher_get_relative_path(watcher, file);
+  if (!rfile)
+    return depth;
 
-  g_hash_table_iter_init(&iter, watcher->monitors);
-  while (g_hash_table_iter_next(&iter, &key, &value))
+  for (; *rfile; rfile++)
     {
-      w_path = (gchar *) key;
-      w_monitor = (GFileMonitor *) value;
+      if (*rfile == G_DIR_SEPARATOR)
+        depth++;
+    }
 
-      if (g_strcmp0(w_path, watcher->path) == 0)
-        continue;
+  return depth;
+}
 
-      w_file = g_file_new_for_path(w_path);
+gboolean
+watcher_is_pruned(const watcher_t *watcher, const gchar *path)
+{
+  const gchar *rpath, *name;
+  gint i;
 
-      if (g_file_equal(w_file, file) || g_file_has_prefix(w_file, file))
+  if (!watcher->prunes)
+    return FALSE;
+
+  rpath = watcher_get_relative_path(watcher, path);
+  if (!rpath || (*rpath == '\0'))
+    return FALSE;
+
+  name = strrchr(rpath, G_DIR_SEPARATOR);
+  name = name ? name + 1 : rpath;
+
+  for (i = 0; watcher->prunes[i] != NULL; i++)
+    {
+      if (g_pattern_match_string(watcher->prunes[i], rpath)
+          || g_pattern_match_string(watcher->prunes[i], name))
         {
-          if (!g_file_monitor_is_cancelled(w_monitor))
-            {
-              g_file_monitor_cancel(w_monitor);
-
-              LOG_DEBUG("%s: %s (%s)",
-                  watcher->name, N_("file monitor cancelled"), w_path);
-            }
-          else
-            {
-              LOG_DEBUG("%s: %s (%s)",
-                  watcher->name, N_("file monitor already cancelled"), w_path);
-            }
-
-          g_hash_table_iter_remove(&iter);
-
-          g_object_unref(w_file);
-          g_free(w_path);
-          g_object_unref(w_monitor);
+          LOG_DEBUG("%s: %s (path=%s)",
+              watcher->name, N_("directory pruned"), path);
+
+          return TRUE;
         }
     }
 
-  g_object_unref(file);
+  return FALSE;
 }
 
-void
-watcher_destroy_monitors(const watcher_t *watcher)
+static gboolean
+watcher_crawl_prune(const gchar *path, gpointer user_data)
 {
-  GFileMonitor *monitor;
-  gchar *path;
-  GHashTableIter iter;
-  gpointer key, value;
-
-  g_hash_table_iter_init(&iter, watcher->monitors);
-  while (g_hash_table_iter_next(&iter, &key, &value))
-    {
-      path = (gchar *) key;
-      monitor = (GFileMonitor *) value;
-
-      if (!g_file_monitor_is_cancelled(monitor))
-        {
-          g_file_monitor_cancel(monitor);
+  return watcher_is_pruned((const watcher_t *) user_data, path);
+}
 
-          LOG_DEBUG("%s: %s (%s)",
-              watcher->name, N_("file monitor cancelled"), path);
-        }
-      else
-        {
-          LOG_DEBUG("%s: %s (%s)",
-              watcher->name, N_("file monitor already cancelled"), path);
-        }
+static gboolean
+watcher_crawl_directory(const gchar *path, guint depth, gpointer user_data)
+{
+  return watcher_add_monitor_for_path((const watcher_t *) user_data, path);
+}
 
-      g_free(path);
-      g_object_unref(monitor);
-    }
+static gboolean
+watcher_crawl_collect(const gchar *path, guint depth, gpointer user_data)
+{
+  g_ptr_array_add((GPtrArray *) user_data, g_strdup(path));
 
-  g_hash_table_remove_all(watcher->monitors);
+  return TRUE;
 }
 
-void
-watcher_list_monitors(const watcher_t *watcher)
+gboolean
+watcher_add_monitor_for_recursive_path(const watcher_t *watcher,
+    const gchar *path, guint depth)
 {
-  gchar *path;
-  GHashTableIter iter;
-  gpointer key, value;
+  GPtrArray *paths;
+  gboolean ret;
+  guint i;
 
-  LOG_INFO("%s: %s", watcher->name, N_("listing monitors"));
+  if (watcher->backend == WATCHER_BACKEND_FANOTIFY)
+    return watcher_add_monitor_for_path(watcher, path);
 
-  g_hash_table_iter_init(&iter, watcher->monitors);
-  while (g_hash_table_iter_next(&iter, &key, &value))
+  if ((watcher->maxdepth > 0) && (depth > watcher->maxdepth))
     {
-      path = (gchar *) key;
+      LOG_DEBUG("%s: %s (depth=%d, path=%s)",
+          watcher->name, N_("maximum depth of recursion reached"), depth, path);
 
-      LOG_INFO("%s: +-- path=%s", watcher->name, path);
+      return TRUE;
     }
 
-  LOG_INFO("%s: %s", watcher->name, N_("end of list"));
+  if (watcher_is_pruned(watcher, path))
+    return TRUE;
+
+  if (watcher->backend != WATCHER_BACKEND_GIO)
+    return crawler_run(path, depth, watcher->maxdepth, watcher->mount,
+        app->crawler_threads, watcher_crawl_prune, watcher_crawl_directory,
+        NULL, (gpointer) watcher);
+
+  /* GIO monitors belong to the main context of the thread creating them */
+  paths = g_ptr_array_new();
+
+  ret = crawler_run(path, depth, watcher->maxdepth, watcher->mount,
+      app->crawler_threads, watcher_crawl_prune, watcher_crawl_collect, NULL,
+      paths);
+
+  for (i = 0; ret && (i < paths->len); i++)
+    ret = watcher_add_monitor_for_path(watcher,
+        (const gchar *) g_ptr_array_index(paths, i));
+
+  for (i = 0; i < paths->len; i++)
+    g_free(g_ptr_array_index(paths, i));
+
+  g_ptr_array_free(paths, TRUE);
+
+  return ret;
 }
 
-void
-watcher_event(GFileMonitor *monitor, GFile *file, GFile *other_file,
-    GFileMonitorEvent event_type, gpointer user_data)
+static void
+watcher_cancel_monitor(tree_node_t *node, gpointer user_data)
 {
-  GFile *parent, *top, *tmp;
-  gboolean depth = 1;
-  watcher_t *watcher;
-  watcher_event_t *event;
+  const watcher_t *watcher = (const watcher_t *) user_data;
+  gchar *path;
 
-  if (!user_data)
+  if (!node->monitor)
     return;
 
-  watcher = (watcher_t *) user_data;
-
-  parent = g_file_new_for_path(watcher->path);
-
-  event = (watcher_event_t *) g_new0(watcher_event_t, 1);
-  event->watcher = watcher;
-  event->file = g_file_get_path(file);
-  event->rfile = g_file_get_relative_path(parent, file);
-  if (!event->rfile)
-    event->rfile = g_strdup("");
+  path = tree_node_get_path(node);
 
-  if (watcher->recursive)
+  if (node->polled)
     {
-      for (top = g_file_dup(file), depth = 1;
-          !g_file_equal(top, parent) && !g_file_has_parent(top, parent); top =
-              tmp, depth++)
-        {
-          tmp = g_file_get_parent(top);
+      polling_remove((watcher_t *) watcher, node);
 
-          g_object_unref(top);
-        }
+      LOG_DEBUG("%s: %s (%s)",
+          watcher->name, N_("directory polling removed"), path);
 
-      g_object_unref(top);
+      g_free(path);
 
-      LOG_DEBUG("%s: file depth to watcher path is '%d'", watcher->name, depth);
+      return;
     }
 
-  g_object_unref(parent);
+#ifdef OS_LINUX
+  if (watcher->backend == WATCHER_BACKEND_INOTIFY)
+    {
+      monitor_inotify_remove_watch(node,
+          (monitor_inotify_watch_t *) node->monitor);
+      node->monitor = NULL;
 
-  LOG_DEBUG("%s: %s (event_type=%d, file=%s)",
-      watcher->name, N_("watcher event received"), event_type, event->file);
+      LOG_DEBUG("%s: %s (%s)",
+          watcher->name, N_("inotify watch removed"), path);
 
-  switch (event_type)
-  {
-  case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
-    {
-      event->event = g_strdup(CONFIG_KEY_WATCHER_EVENT_CHANGING);
+      g_free(path);
 
-      break;
+      return;
     }
+#endif
 
-  case G_FILE_MONITOR_EVENT_CHANGED:
+  if (!g_file_monitor_is_cancelled((GFileMonitor *) node->monitor))
     {
-      event->event = g_strdup(CONFIG_KEY_WATCHER_EVENT_CHANGED);
+      g_file_monitor_cancel((GFileMonitor *) node->monitor);
 
-      break;
+      LOG_DEBUG("%s: %s (%s)",
+          watcher->name, N_("file monitor cancelled"), path);
     }
-
-  case G_FILE_MONITOR_EVENT_CREATED:
+  else
     {
-      event->event = g_strdup(CONFIG_KEY_WATCHER_EVENT_CREATED);
-
-      break;
+      LOG_DEBUG("%s: %s (%s)",
+          watcher->name, N_("file monitor already cancelled"), path);
     }
 
-  case G_FILE_MONITOR_EVENT_DELETED:
-    {
-      event->event = g_strdup(CONFIG_KEY_WATCHER_EVENT_DELETED);
+  g_object_unref(node->monitor);
+  node->monitor = NULL;
 
-      break;
-    }
+  g_free(path);
+}
 
-  case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
+void
+watcher_remove_monitor_for_path(const watcher_t *watcher, const gchar *path)
+{
+  tree_node_t *node;
+
+  LOG_DEBUG("%s: %s (path=%s)",
+      watcher->name, N_("removing file monitor for path"), path);
+
+#ifdef MONITOR_FANOTIFY_SUPPORTED
+  if (watcher->backend == WATCHER_BACKEND_FANOTIFY)
     {
-      event->event = g_strdup(CONFIG_KEY_WATCHER_EVENT_ATTRIBUTECHANGED);
+      if (g_strcmp0(path, watcher->path) == 0)
+        monitor_fanotify_destroy((watcher_t *) watcher);
 
-      break;
+      return;
     }
+#endif
 
-  default:
-    {
-      LOG_DEBUG("%s: %s (event_type=%d)",
-          watcher->name, N_("unknown event"), event_type);
+  node = tree_lookup(watcher->monitors, path);
+  if (!node)
+    return;
 
-      g_free(event->file);
-      g_free(event->rfile);
-      g_free(event);
+  watcher_cancel_monitor(node, (gpointer) watcher);
+  watcher_release_node(watcher, node);
+}
 
-      return;
+void
+watcher_remove_monitor_for_recursive_path(const watcher_t *watcher,
+    const gchar *path)
+{
+  tree_node_t *node, *child;
 
-      break;
-    }
-  }
+  LOG_DEBUG("%s: %s (path=%s)",
+      watcher->name, N_("removing file monitors for recursive path"), path);
 
-  if ((event_type == G_FILE_MONITOR_EVENT_DELETED) && watcher->recursive
-      && (g_strcmp0(event->file, watcher->path) != 0))
+#ifdef MONITOR_FANOTIFY_SUPPORTED
+  if (watcher->backend == WATCHER_BACKEND_FANOTIFY)
     {
-      watcher_remove_monitor_for_recursive_path(watcher, event->file);
+      if (g_strcmp0(path, watcher->path) == 0)
+        monitor_fanotify_destroy((watcher_t *) watcher);
+
+      return;
     }
+#endif
 
-  if (!watcher_event_test(watcher, event))
+  node = tree_lookup(watcher->monitors, path);
+  if (!node)
+    return;
+
+  /* the monitor of the watcher path itself is kept */
+  if (!node->parent)
     {
-      LOG_DEBUG("%s: %s (event=%s, file=%s)",
-          watcher->name, N_("event ignored"), event->event, event->file);
+      for (child = node->children; child; child = child->next)
+        tree_foreach(child, watcher_cancel_monitor, (gpointer) watcher);
 
-      g_free(event->event);
-      g_free(event->file);
-      g_free(event->rfile);
-      g_free(event);
+      tree_remove(watcher->monitors, node);
 
       return;
     }
 
-  if (event_type == G_FILE_MONITOR_EVENT_CREATED && watcher->recursive
-      && g_file_test(event->file, G_FILE_TEST_IS_DIR)
-  && (g_strcmp0(event->file, watcher->path) != 0))
+  tree_foreach(node, watcher_cancel_monitor, (gpointer) watcher);
+
+  while (node->children)
+    tree_remove(watcher->monitors, node->children);
+
+  watcher_release_node(watcher, node);
+}
+
+void
+watcher_destroy_monitors(const watcher_t *watcher)
+{
+  tree_node_t *root;
+
+  root = &watcher->monitors->root;
+
+  tree_foreach(root, watcher_cancel_monitor, (gpointer) watcher);
+  tree_remove(watcher->monitors, root);
+
+  attach_cancel((watcher_t *) watcher);
+  polling_cancel((watcher_t *) watcher);
+
+#ifdef MONITOR_FANOTIFY_SUPPORTED
+  monitor_fanotify_destroy((watcher_t *) watcher);
+#endif
+}
+
+static void
+watcher_list_monitor(tree_node_t *node, gpointer user_data)
+{
+  const watcher_t *watcher = (const watcher_t *) user_data;
+  gchar *path;
+
+  if (!node->monitor)
+    return;
+
+  path = tree_node_get_path(node);
+
+  if (node->polled)
     {
-      watcher_add_monitor_for_recursive_path(watcher, event->file, depth);
+      LOG_INFO("%s: +-- path=%s (%s)", watcher->name, path, N_("polled"));
     }
+  else
+    {
+      LOG_INFO("%s: +-- path=%s", watcher->name, path);
+    }
+
+  g_free(path);
+}
+
+void
+watcher_list_monitors(const watcher_t *watcher)
+{
+  LOG_INFO("%s: %s", watcher->name, N_("listing monitors"));
 
-  watcher_event_fired(watcher, event);
+  tree_foreach(&watcher->monitors->root, watcher_list_monitor,
+      (gpointer) watcher);
 
-  g_free(event->event);
-  g_free(event->file);
-  g_free(event->rfile);
-  g_free(event);
+  LOG_INFO("%s: %s", watcher->name, N_("end of list"));
 }
 
-gboolean
-watcher_event_test(watcher_t *watcher, watcher_event_t *event)
+void
+watcher_event(GFileMonitor *monitor, GFile *file, GFile *other_file,
+    GFileMonitorEvent event_type, gpointer user_data)
 {
-  gboolean found = FALSE;
-  gboolean include = TRUE;
-  gint i;
+  gchar *path;
 
-  if (watcher->events)
-    {
-      for (i = 0; watcher->events[i] != NULL; i++)
-        {
-          if (g_strcmp0(watcher->events[i], event->event) == 0)
-            {
-              found = TRUE;
+  if (!user_data)
+    return;
 
-              break;
-            }
-        }
+  path = g_file_get_path(file);
 
-      if (!found)
-        return FALSE;
-    }
+  statcache_begin();
 
-  if ((g_strcmp0(event->event, CONFIG_KEY_WATCHER_EVENT_DELETED) != 0)
-      && (g_strcmp0(event->event, CONFIG_KEY_WATCHER_EVENT_UNMOUNTED) != 0))
-    {
-#ifndef GStatBuf
-      struct stat st_path, st_file;
-#else
-      GStatBuf st_path, st_file;
-#endif
+  watcher_event_process((watcher_t *) user_data, path, event_type);
 
-      memset(&st_path, 0, sizeof(st_path));
-      memset(&st_file, 0, sizeof(st_file));
+  g_free(path);
+}
 
-      if (g_stat(event->watcher->path, &st_path) != 0)
-        {
-          LOG_ERROR("%s '%s'",
-              N_("failed to stat the watcher path"), event->watcher->path);
+guint
+watcher_get_event_mask(GFileMonitorEvent event_type)
+{
+  switch (event_type)
+  {
+  case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    return WATCHER_EVENT_CHANGING;
 
-          return FALSE;
-        }
+  case G_FILE_MONITOR_EVENT_CHANGED:
+    return WATCHER_EVENT_CHANGED;
 
-      if (g_stat(event->file, &st_file) != 0)
-        {
-          LOG_ERROR("%s '%s'",
-              N_("failed to stat the watched file"), event->file);
+  case G_FILE_MONITOR_EVENT_CREATED:
+    return WATCHER_EVENT_CREATED;
 
-          return FALSE;
-        }
+  case G_FILE_MONITOR_EVENT_DELETED:
+    return WATCHER_EVENT_DELETED;
 
-      if (watcher->mount)
-        {
-          if (st_file.st_dev != st_path.st_dev)
-            {
-              LOG_DEBUG("%s", N_("the filesystems are not the same"));
+  case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
+    return WATCHER_EVENT_ATTRIBUTECHANGED;
 
-              return FALSE;
-            }
-        }
+  default:
+    return 0;
+  }
+}
 
-      if (watcher->readable)
-        {
-          if (g_access (event->file, R_OK) != 0)
-            {
-              LOG_DEBUG("%s", N_("the file is not readable"));
+const gchar *
+watcher_get_event_name(guint mask)
+{
+  switch (mask)
+  {
+  case WATCHER_EVENT_CHANGING:
+    return CONFIG_KEY_WATCHER_EVENT_CHANGING;
 
-              return FALSE;
-            }
-        }
+  case WATCHER_EVENT_CHANGED:
+    return CONFIG_KEY_WATCHER_EVENT_CHANGED;
 
-      if (watcher->writable)
-        {
-          if (g_access (event->file, W_OK) != 0)
-            {
-              LOG_DEBUG("%s", N_("the file is not writable"));
+  case WATCHER_EVENT_CREATED:
+    return CONFIG_KEY_WATCHER_EVENT_CREATED;
 
-              return FALSE;
-            }
-        }
+  case WATCHER_EVENT_DELETED:
+    return CONFIG_KEY_WATCHER_EVENT_DELETED;
 
-      if (watcher->executable)
-        {
-          if (g_access (event->file, X_OK) != 0)
-            {
-              LOG_DEBUG("%s", N_("the file is not executable"));
+  case WATCHER_EVENT_ATTRIBUTECHANGED:
+    return CONFIG_KEY_WATCHER_EVENT_ATTRIBUTECHANGED;
 
-              return FALSE;
-            }
-        }
+  case WATCHER_EVENT_MOUNTED:
+    return CONFIG_KEY_WATCHER_EVENT_MOUNTED;
 
-      if (!S_ISDIR(st_file.st_mode) && (watcher->size > -1))
-        {
-          guint size;
+  case WATCHER_EVENT_UNMOUNTED:
+    return CONFIG_KEY_WATCHER_EVENT_UNMOUNTED;
 
-          switch (watcher->size_unit)
-          {
-          case WATCHER_SIZE_UNIT_KBYTES:
-            {
-              size = watcher->size * 1024;
+  default:
+    return NULL;
+  }
+}
 
-              break;
-            }
+guint
+watcher_get_required_events(const watcher_t *watcher)
+{
+  guint mask;
 
+  mask = watcher->event_mask;
 
-          case WATCHER_SIZE_UNIT_MBYTES:
-            {
-              size = watcher->size * 1048576;
+  /* the monitors of a recursive watcher follow the created and deleted
+   * directories */
+  if (watcher->recursive && (watcher->backend != WATCHER_BACKEND_FANOTIFY))
+    mask |= WATCHER_EVENT_CREATED | WATCHER_EVENT_DELETED;
 
-              break;
-            }
+  return mask;
+}
 
+void
+watcher_event_deliver(watcher_t *watcher, const gchar *file,
+    GFileMonitorEvent event_type)
+{
+  if (!(watcher->event_mask & watcher_get_event_mask(event_type)))
+    return;
 
-          case WATCHER_SIZE_UNIT_GBYTES:
-            {
-              size = watcher->size * 1073741824;
+  if (watcher->coalescer)
+    {
+      coalesce_add(watcher->coalescer, file, event_type);
 
-              break;
-            }
+      return;
+    }
 
-          case WATCHER_SIZE_UNIT_BYTES:
-          default:
-            {
-              size = watcher->size;
+  if (watcher->queue)
+    {
+      queue_push(watcher->queue, file, event_type);
 
-              break;
-            }
-          }
+      return;
+    }
 
-          switch (watcher->size_cmp)
-          {
-          case WATCHER_SIZE_COMPARE_GREATER:
-            {
-              if (st_file.st_size <= size)
-                {
-                  LOG_DEBUG("%s", N_("the file size is not greater"));
+  watcher_event_dispatch(watcher, file, event_type);
+}
 
-                  return FALSE;
-                }
+void
+watcher_event_process(watcher_t *watcher, const gchar *file,
+    GFileMonitorEvent event_type)
+{
+  guint depth = 1;
 
-              break;
-            }
+  /* a vanished file may have been created again */
+  if (event_type == G_FILE_MONITOR_EVENT_CREATED)
+    statcache_forget(file);
 
-          case WATCHER_SIZE_COMPARE_LESS:
-            {
-              if (st_file.st_size >= size)
-                {
-                  LOG_DEBUG("%s", N_("the file size is not less"));
+  if (!(watcher_get_required_events(watcher)
+      & watcher_get_event_mask(event_type)))
+    return;
 
-                  return FALSE;
-                }
+  /* the subtrees being attached hold their events */
+  if (attach_buffer(watcher, file, event_type))
+    return;
 
-              break;
-            }
+  if (attach_is_synthetic(watcher, file, event_type))
+    {
+      LOG_DEBUG("%s: %s (file=%s)",
+          watcher->name, N_("event already reported by the crawl"), file);
 
-          case WATCHER_SIZE_COMPARE_EQUAL:
-          default:
-            {
-              if (st_file.st_size != size)
-                {
-                  LOG_DEBUG("%s", N_("the file size is not equal"));
+      return;
+    }
 
-                  return FALSE;
-                }
+  LOG_DEBUG("%s: %s (event_type=%d, file=%s)",
+      watcher->name, N_("watcher event received"), event_type, file);
 
-              break;
-            }
-          }
-        }
+  if (watcher->recursive)
+    {
+      depth = watcher_get_depth(watcher, file);
 
-      if (watcher->type)
-        {
-          if (S_ISBLK(st_file.st_mode))
-            {
-              if (g_strcmp0(watcher->type, CONFIG_KEY_WATCHER_TYPE_BLOCK) != 0)
-                {
-                  LOG_DEBUG("%s", N_("the file type doesn't match"));
-
-                  return FALSE;
-                }
-            }
-          else if (S_ISCHR(st_file.st_mode))
-            {
-              if (g_strcmp0(watcher->type, CONFIG_KEY_WATCHER_TYPE_CHARACTER)
-                  != 0)
-                {
-                  LOG_DEBUG("%s", N_("the file type doesn't match"));
-
-                  return FALSE;
-                }
-            }
-          else if (S_ISDIR(st_file.st_mode))
-            {
-              if (g_strcmp0(watcher->type, CONFIG_KEY_WATCHER_TYPE_DIRECTORY)
-                  != 0)
-                {
-                  LOG_DEBUG("%s", N_("the file type doesn't match"));
-
-                  return FALSE;
-                }
-            }
-          else if (S_ISREG(st_file.st_mode))
-            {
-              if (g_strcmp0(watcher->type, CONFIG_KEY_WATCHER_TYPE_REGULAR)
-                  != 0)
-                {
-                  LOG_DEBUG("%s", N_("the file type doesn't match"));
-
-                  return FALSE;
-                }
-            }
-          else if (S_ISLNK(st_file.st_mode))
-            {
-              if (g_strcmp0(watcher->type, CONFIG_KEY_WATCHER_TYPE_SYMBOLICLINK)
-                  != 0)
-                {
-                  LOG_DEBUG("%s", N_("the file type doesn't match"));
-
-                  return FALSE;
-                }
-            }
-          else if (S_ISFIFO(st_file.st_mode))
-            {
-              if (g_strcmp0(watcher->type, CONFIG_KEY_WATCHER_TYPE_FIFO) != 0)
-                {
-                  LOG_DEBUG("%s", N_("the file type doesn't match"));
-
-                  return FALSE;
-                }
-            }
-          else if (S_ISSOCK(st_file.st_mode))
-            {
-              if (g_strcmp0(watcher->type, CONFIG_KEY_WATCHER_TYPE_SOCKET) != 0)
-                {
-                  LOG_DEBUG("%s", N_("the file type doesn't match"));
-
-                  return FALSE;
-                }
-            }
-          else
-            {
-              LOG_DEBUG("%s (%d)",
-                  N_("the file type is unknown"), st_file.st_mode);
-
-              return FALSE;
-            }
-
-          if (watcher->user)
-            {
-              struct passwd *pwd;
-
-              pwd = getpwnam(watcher->user);
-              if (!pwd)
-                {
-                  gchar *err;
-                  uid_t uid;
-
-                  LOG_DEBUG("%s",
-                      N_("failed to retrieve the user name, trying the user id"));
-
-                  uid = (uid_t) strtol(watcher->user, &err, 10);
-                  if ((err == watcher->user) || (errno == ERANGE)
-                      || (errno == EINVAL))
-                    {
-                      LOG_DEBUG("%s", N_("invalid value"));
-
-                      return FALSE;
-                    }
-
-                  pwd = getpwuid(uid);
-                  if (!pwd)
-                    {
-                      LOG_DEBUG("%s", N_("failed to retrieve the user id"));
-
-                      return FALSE;
-                    }
-                }
-
-              if (pwd->pw_uid != st_file.st_uid)
-                {
-                  LOG_DEBUG("%s", N_("the owner user matches"));
-
-                  return FALSE;
-                }
-            }
-
-          if (watcher->group)
-            {
-              struct group *grp;
-
-              grp = getgrnam(watcher->group);
-              if (!grp)
-                {
-                  gchar *err;
-                  gid_t gid;
-
-                  LOG_DEBUG("%s",
-                      N_("failed to retrieve the group name, trying the group id"));
-
-                  gid = (gid_t) strtol(watcher->group, &err, 10);
-                  if ((err == watcher->group) || (errno == ERANGE)
-                      || (errno == EINVAL))
-                    {
-                      LOG_DEBUG("%s", N_("invalid value"));
-
-                      return FALSE;
-                    }
-
-                  grp = getgrgid(gid);
-                  if (!grp)
-                    {
-                      LOG_DEBUG("%s", N_("failed to retrieve the group id"));
-
-                      return FALSE;
-                    }
-                }
-
-              if (grp->gr_gid != st_file.st_gid)
-                {
-                  LOG_DEBUG("%s", N_("the owner group matches"));
-
-                  return FALSE;
-                }
-            }
-        }
+      LOG_DEBUG("%s: file depth to watcher path is '%d'", watcher->name, depth);
     }
 
-  if (watcher->includes)
+  if ((event_type == G_FILE_MONITOR_EVENT_DELETED) && watcher->recursive
+      && (watcher->backend != WATCHER_BACKEND_FANOTIFY)
+      && (g_strcmp0(file, watcher->path) != 0))
     {
-      include = FALSE;
+      watcher_remove_monitor_for_recursive_path(watcher, file);
+    }
 
-      for (i = 0; watcher->includes[i] != NULL; i++)
-        {
-          if (g_pattern_match_simple(watcher->includes[i], event->rfile))
-            {
-              LOG_DEBUG("%s", N_("relative filename found in include list"));
+  /* new directories are attached whatever the event filters, unless pruned */
+  if (event_type == G_FILE_MONITOR_EVENT_CREATED && watcher->recursive
+      && (watcher->backend != WATCHER_BACKEND_FANOTIFY)
+      && g_file_test(file, G_FILE_TEST_IS_DIR)
+      && (g_strcmp0(file, watcher->path) != 0))
+    {
+      attach_start(watcher, file, depth);
+    }
 
-              return TRUE;
-            }
-        }
+  watcher_event_deliver(watcher, file, event_type);
+}
+
+void
+watcher_event_dispatch(watcher_t *watcher, const gchar *file,
+    GFileMonitorEvent event_type)
+{
+  watcher_event_t event;
+
+  event.mask = watcher_get_event_mask(event_type);
+  if (!event.mask)
+    {
+      LOG_DEBUG("%s: %s (event_type=%d)",
+          watcher->name, N_("unknown event"), event_type);
+
+      return;
     }
 
-  if (watcher->excludes)
+  event.watcher = watcher;
+  event.event = watcher_get_event_name(event.mask);
+  event.file = file;
+  event.rfile = watcher_get_relative_path(watcher, file);
+  if (!event.rfile)
+    event.rfile = "";
+
+  if (!watcher_event_test(watcher, &event))
     {
-      for (i = 0; watcher->excludes[i] != NULL; i++)
-        {
-          if (g_pattern_match_simple(watcher->excludes[i], event->rfile))
-            {
-              LOG_DEBUG("%s", N_("relative filename found in exclude list"));
+      LOG_DEBUG("%s: %s (event=%s, file=%s)",
+          watcher->name, N_("event ignored"), event.event, event.file);
 
-              return FALSE;
-            }
-        }
+      return;
     }
 
-  return include;
+  watcher_event_fired(watcher, &event);
+}
+
+gboolean
+watcher_event_test(watcher_t *watcher, watcher_event_t *event)
+{
+  return filter_run(watcher->filter, event);
 }
 
 void
 watcher_event_fired(watcher_t *watcher, watcher_event_t *event)
 {
-  GError *error = NULL;
-  GRegex *regex;
-  gchar *exec, *tmp;
+  gchar **argv;
+  gchar *line;
 
   LOG_INFO( "%s: %s (event=%s, file=%s)",
       watcher->name, N_("event fired"), event->event, event->file);
 
-  if (watcher->exec)
-    {
-      regex = g_regex_new("\\" CONFIG_KEY_WATCHER_EXEC_KEY_NAME, 0, 0, &error);
-      exec = g_regex_replace_literal(regex, watcher->exec, -1, 0, watcher->name,
-          0, &error);
-      g_regex_unref(regex);
-
-      tmp = exec;
-      regex = g_regex_new("\\" CONFIG_KEY_WATCHER_EXEC_KEY_PATH, 0, 0, &error);
-      exec = g_regex_replace_literal(regex, tmp, -1, 0, watcher->path, 0,
-          &error);
-      g_regex_unref(regex);
-      g_free(tmp);
-
-      tmp = exec;
-      regex = g_regex_new("\\" CONFIG_KEY_WATCHER_EXEC_KEY_EVENT, 0, 0, &error);
-      exec = g_regex_replace_literal(regex, tmp, -1, 0, event->event, 0,
-          &error);
-      g_regex_unref(regex);
-      g_free(tmp);
-
-      tmp = exec;
-      regex = g_regex_new("\\" CONFIG_KEY_WATCHER_EXEC_KEY_FILE, 0, 0, &error);
-      exec = g_regex_replace_literal(regex, tmp, -1, 0, event->file, 0, &error);
-      g_regex_unref(regex);
-      g_free(tmp);
-
-      tmp = exec;
-      regex = g_regex_new("\\" CONFIG_KEY_WATCHER_EXEC_KEY_RFILE, 0, 0, &error);
-      exec = g_regex_replace_literal(regex, tmp, -1, 0, event->rfile, 0,
-          &error);
-      g_regex_unref(regex);
-      g_free(tmp);
-
-      LOG_INFO("%s: %s '%s'", watcher->name, N_("executing command"), exec);
-
-      g_spawn_command_line_async(exec, &error);
-      g_free(exec);
-      if (error)
-        {
-          LOG_ERROR("%s: %s (%s)",
-              watcher->name, N_("failed to execute command"), error->message);
+  if (watcher->workers)
+    {
+      workers_push(watcher->workers, event);
+    }
+  else if (watcher->batch)
+    {
+      batch_add(watcher->batch, event);
+    }
+  else if (watcher->command)
+    {
+      argv = command_expand(watcher->command, watcher, event);
 
-          g_error_free(error);
-          error = NULL;
-        }
+      line = g_strjoinv(" ", argv);
+      LOG_INFO("%s: %s '%s'", watcher->name, N_("executing command"), line);
+      g_free(line);
+
+      jobs_run(watcher->jobs, event->file, argv, NULL);
     }
 
   if (!app->daemon)
@@ -839,6 +750,3 @@ watcher_event_fired(watcher_t *watcher, watcher_event_t *event)
         g_print("%s", event->file);
     }
 }
-
-
-
@@ -25,16 +25,36 @@ typedef struct _watcher_t
 {
   gchar *name;
   gchar *path;
+  guint backend;
+#define WATCHER_BACKEND_GIO             0
+#define WATCHER_BACKEND_INOTIFY         1
+#define WATCHER_BACKEND_FANOTIFY        2
   gboolean recursive;
   gint maxdepth;
+  gint priority;
   gchar *exec;
+  struct _command_t *command;
+  guint exec_mode;
+#define WATCHER_EXEC_MODE_SPAWN         0
+#define WATCHER_EXEC_MODE_PERSISTENT    1
+  guint exec_workers;
+  guint exec_framing;
+  guint exec_backlog;
+  struct _workers_t *workers;
+  guint max_jobs;
+  guint job_timeout;
+  struct _jobs_t *jobs;
+  guint exec_batch;
+  guint exec_batch_delay;
+  gboolean exec_batch0;
+  struct _batch_t *batch;
   gboolean print;
   gboolean print0;
   gboolean mount;
   gboolean readable;
   gboolean writable;
   gboolean executable;
-  gint size;
+  gint64 size;
   guint size_unit;
 #define WATCHER_SIZE_UNIT_BYTES         0
 #define WATCHER_SIZE_UNIT_KBYTES        1
@@ -47,20 +67,70 @@ typedef struct _watcher_t
   gchar *type;
   gchar *user;
   gchar *group;
+  struct _identity_t *users;
+  struct _identity_t *groups;
+  guint identity_ttl;
   gchar **events;
+  guint event_mask;
+#define WATCHER_EVENT_CHANGING          (1 << 0)
+#define WATCHER_EVENT_CHANGED           (1 << 1)
+#define WATCHER_EVENT_CREATED           (1 << 2)
+#define WATCHER_EVENT_DELETED           (1 << 3)
+#define WATCHER_EVENT_ATTRIBUTECHANGED  (1 << 4)
+#define WATCHER_EVENT_MOUNTED           (1 << 5)
+#define WATCHER_EVENT_UNMOUNTED         (1 << 6)
+#define WATCHER_EVENT_ALL               0x7f
   gchar **includes;
   gchar **excludes;
-  GHashTable *monitors;
+  GRegex *include_regex;
+  GRegex *exclude_regex;
+  struct _expr_t *expr;
+  struct _filter_t *filter;
+  GPatternSpec **prunes;
+  struct _tree_t *monitors;
+  struct _monitor_fanotify_t *fanotify;
+  guint coalesce;
+  struct _coalesce_t *coalescer;
+  guint queue_size;
+  guint queue_policy;
+  struct _queue_t *queue;
+  guint rescan_source;
+#define WATCHER_RESCAN_DELAY            1000
+#define WATCHER_RESCAN_INTERVAL         10000
+  gint64 rescan_time;
+  guint64 rescan_requests;
+  guint64 rescans;
+  GQueue attaches;
+  struct _attach_t *crawl;
+  guint attach_source;
+  guint64 crawled;
+  gint64 crawl_time;
+  GHashTable *synthetics;
+  guint synthetics_source;
+  guint poll_interval;
+  GQueue polls;
+  guint poll_source;
+  guint poll_remaining;
+  guint64 poll_passes;
 } watcher_t;
 
 typedef struct _watcher_event_t
 {
   struct _watcher_t *watcher;
-  gchar *event;
-  gchar *file;
-  gchar *rfile;
+  const gchar *event;
+  guint mask;
+  const gchar *file;
+  const gchar *rfile;
 } watcher_event_t;
 
+void
+watcher_free(watcher_t *watcher);
+const gchar *
+watcher_get_relative_path(const watcher_t *watcher, const gchar *file);
+guint
+watcher_get_depth(watcher_t *watcher, const gchar *file);
+gboolean
+watcher_is_pruned(const watcher_t *watcher, const gchar *path);
 gboolean
 watcher_add_monitor_for_path(const watcher_t *watcher, const gchar *path);
 gboolean
@@ -78,6 +148,21 @@ watcher_list_monitors(const watcher_t *watcher);
 void
 watcher_event(GFileMonitor *monitor, GFile *file, GFile *other_file,
     GFileMonitorEvent event_type, gpointer user_data);
+guint
+watcher_get_event_mask(GFileMonitorEvent event_type);
+const gchar *
+watcher_get_event_name(guint mask);
+guint
+watcher_get_required_events(const watcher_t *watcher);
+void
+watcher_event_process(watcher_t *watcher, const gchar *file,
+    GFileMonitorEvent event_type);
+void
+watcher_event_deliver(watcher_t *watcher, const gchar *file,
+    GFileMonitorEvent event_type);
+void
+watcher_event_dispatch(watcher_t *watcher, const gchar *file,
+    GFileMonitorEvent event_type);
 gboolean
 watcher_event_test(watcher_t *watcher, watcher_event_t *event);
 void
@@ -0,0 +1,523 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "fmon.h"
+#include "command.h"
+#include "queue.h"
+#include "watcher.h"
+#include "workers.h"
+
+#include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#define WORKERS_RESTART_DELAY   1
+#define WORKERS_BUFFER          4096
+
+/*
+ * Persistent workers are long-lived handler processes reading framed event
+ * records on their standard input and writing one line on their standard
+ * output for each record processed. A worker never has more than the backlog
+ * of records waiting for their acknowledgement, the other records wait in its
+ * pending queue. A worker with a full pending queue holds back the event
+ * queue, whose policy then applies to the records delivered anyway: the drop
+ * policies drop them, the block policy lets the pending queue grow. The
+ * records are sharded on the workers by file, so the events of a file are
+ * handled in order by the same worker. The records of a crashed worker are
+ * sent again once it is restarted.
+ */
+
+static gboolean
+worker_start(worker_t *worker);
+static void
+worker_schedule(worker_t *worker);
+
+static void
+worker_free(worker_t *worker)
+{
+  gchar *record;
+
+  while ((record = (gchar *) g_queue_pop_head(&worker->inflight)) != NULL)
+    g_free(record);
+
+  while ((record = (gchar *) g_queue_pop_head(&worker->pending)) != NULL)
+    g_free(record);
+
+  g_string_free(worker->output, TRUE);
+  g_string_free(worker->acks, TRUE);
+  g_free(worker);
+}
+
+static void
+worker_close(worker_t *worker)
+{
+  if (worker->in_source)
+    {
+      g_source_remove(worker->in_source);
+      worker->in_source = 0;
+    }
+
+  if (worker->out_source)
+    {
+      g_source_remove(worker->out_source);
+      worker->out_source = 0;
+    }
+
+  if (worker->in_fd >= 0)
+    {
+      close(worker->in_fd);
+      worker->in_fd = -1;
+    }
+
+  if (worker->out_fd >= 0)
+    {
+      close(worker->out_fd);
+      worker->out_fd = -1;
+    }
+
+  g_string_truncate(worker->output, 0);
+  g_string_truncate(worker->acks, 0);
+  worker->offset = 0;
+}
+
+static gboolean
+worker_write(GIOChannel *channel, GIOCondition condition, gpointer user_data)
+{
+  worker_t *worker;
+  gssize len;
+
+  worker = (worker_t *) user_data;
+
+  while (worker->offset < worker->output->len)
+    {
+      len = write(worker->in_fd, worker->output->str + worker->offset,
+          worker->output->len - worker->offset);
+      if (len < 0)
+        {
+          if (errno == EINTR)
+            continue;
+
+          if (errno == EAGAIN)
+            {
+              if (!worker->in_source)
+                {
+                  channel = g_io_channel_unix_new(worker->in_fd);
+                  worker->in_source = g_io_add_watch(channel,
+                      G_IO_OUT | G_IO_ERR | G_IO_HUP, worker_write, worker);
+                  g_io_channel_unref(channel);
+                }
+
+              return TRUE;
+            }
+
+          /* the worker exit is handled by its child watch */
+          LOG_ERROR("%s: %s (worker=%d, %s)",
+              worker->workers->watcher->name,
+              N_("failed to write events to worker"), worker->id,
+              g_strerror(errno));
+
+          break;
+        }
+
+      worker->offset += len;
+    }
+
+  g_string_truncate(worker->output, 0);
+  worker->offset = 0;
+  worker->in_source = 0;
+
+  return FALSE;
+}
+
+static gboolean
+worker_read(GIOChannel *channel, GIOCondition condition, gpointer user_data)
+{
+  worker_t *worker;
+  workers_t *workers;
+  gchar buffer[WORKERS_BUFFER];
+  gchar *record, *line;
+  gssize len;
+  gsize i;
+
+  worker = (worker_t *) user_data;
+  workers = worker->workers;
+
+  len = read(worker->out_fd, buffer, sizeof(buffer));
+  if ((len < 0) && ((errno == EAGAIN) || (errno == EINTR)))
+    return TRUE;
+
+  if (len <= 0)
+    {
+      worker->out_source = 0;
+
+      return FALSE;
+    }
+
+  for (i = 0; i < (gsize) len; i++)
+    {
+      if (buffer[i] != '\n')
+        {
+          g_string_append_c(worker->acks, buffer[i]);
+
+          continue;
+        }
+
+      line = worker->acks->str;
+
+      record = (gchar *) g_queue_pop_head(&worker->inflight);
+      if (!record)
+        {
+          LOG_ERROR("%s: %s (worker=%d, ack=%s)",
+              workers->watcher->name, N_("unexpected worker acknowledgement"),
+              worker->id, line);
+        }
+      else
+        {
+          LOG_DEBUG("%s: %s (worker=%d, record=%s, ack=%s)",
+              workers->watcher->name, N_("event acknowledged by worker"),
+              worker->id, record, line);
+
+          workers->acked++;
+
+          g_free(record);
+        }
+
+      g_string_truncate(worker->acks, 0);
+    }
+
+  worker_schedule(worker);
+
+  return TRUE;
+}
+
+static gboolean
+worker_restart(gpointer user_data)
+{
+  worker_t *worker;
+
+  worker = (worker_t *) user_data;
+  worker->restart_source = 0;
+
+  if (worker_start(worker))
+    worker_schedule(worker);
+  else
+    worker->restart_source = g_timeout_add_seconds(WORKERS_RESTART_DELAY,
+        worker_restart, worker);
+
+  return FALSE;
+}
+
+static void
+worker_exited(GPid pid, gint status, gpointer user_data)
+{
+  worker_t *worker;
+  workers_t *workers;
+  gchar *record;
+
+  worker = (worker_t *) user_data;
+  workers = worker->workers;
+
+  g_spawn_close_pid(pid);
+
+  worker->pid = 0;
+  worker->child_source = 0;
+
+  /* the workers have been stopped */
+  if (!workers)
+    {
+      worker_free(worker);
+
+      return;
+    }
+
+  LOG_ERROR("%s: %s (worker=%d, pid=%d, status=%d)",
+      workers->watcher->name, N_("worker exited, restarting"), worker->id, pid,
+      status);
+
+  worker_close(worker);
+
+  /* the records not acknowledged are sent again, in order */
+  while ((record = (gchar *) g_queue_pop_tail(&worker->inflight)) != NULL)
+    g_queue_push_head(&worker->pending, record);
+
+  workers->restarts++;
+
+  worker->restart_source = g_timeout_add_seconds(WORKERS_RESTART_DELAY,
+      worker_restart, worker);
+}
+
+static gboolean
+worker_start(worker_t *worker)
+{
+  workers_t *workers;
+  GIOChannel *channel;
+  GError *error = NULL;
+  gchar **argv;
+
+  workers = worker->workers;
+
+  argv = command_expand(workers->watcher->command, workers->watcher, NULL);
+
+  g_spawn_async_with_pipes(NULL, argv, NULL,
+      G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL,
+      &worker->pid, &worker->in_fd, &worker->out_fd, NULL, &error);
+  g_strfreev(argv);
+  if (error)
+    {
+      LOG_ERROR("%s: %s (worker=%d, %s)",
+          workers->watcher->name, N_("failed to start worker"), worker->id,
+          error->message);
+
+      g_error_free(error);
+      error = NULL;
+
+      worker->pid = 0;
+      worker->in_fd = -1;
+      worker->out_fd = -1;
+
+      return FALSE;
+    }
+
+  LOG_INFO("%s: %s (worker=%d, pid=%d)",
+      workers->watcher->name, N_("worker started"), worker->id, worker->pid);
+
+  fcntl(worker->in_fd, F_SETFD, FD_CLOEXEC);
+  fcntl(worker->out_fd, F_SETFD, FD_CLOEXEC);
+  fcntl(worker->in_fd, F_SETFL, fcntl(worker->in_fd, F_GETFL) | O_NONBLOCK);
+  fcntl(worker->out_fd, F_SETFL, fcntl(worker->out_fd, F_GETFL) | O_NONBLOCK);
+
+  channel = g_io_channel_unix_new(worker->out_fd);
+  worker->out_source = g_io_add_watch(channel, G_IO_IN | G_IO_HUP, worker_read,
+      worker);
+  g_io_channel_unref(channel);
+
+  worker->child_source = g_child_watch_add(worker->pid, worker_exited, worker);
+
+  return TRUE;
+}
+
+static void
+worker_send(worker_t *worker, gchar *record)
+{
+  workers_t *workers;
+  gsize len;
+
+  workers = worker->workers;
+
+  len = strlen(record);
+
+  switch (workers->framing)
+  {
+  case WORKERS_FRAMING_NULL:
+    g_string_append_len(worker->output, record, len + 1);
+    break;
+
+  case WORKERS_FRAMING_LENGTH:
+    g_string_append_printf(worker->output, "%lu\n", (gulong) len);
+    g_string_append_len(worker->output, record, len);
+    break;
+
+  default:
+    g_string_append_len(worker->output, record, len);
+    g_string_append_c(worker->output, '\n');
+    break;
+  }
+
+  g_queue_push_tail(&worker->inflight, record);
+
+  workers->sent++;
+}
+
+static void
+worker_schedule(worker_t *worker)
+{
+  /* a busy worker holds the records back in its pending queue */
+  while ((worker->in_fd >= 0) && !g_queue_is_empty(&worker->pending)
+      && (worker->inflight.length < worker->workers->backlog))
+    worker_send(worker, (gchar *) g_queue_pop_head(&worker->pending));
+
+  if ((worker->output->len > 0) && !worker->in_source)
+    worker_write(NULL, G_IO_OUT, worker);
+
+  /* the event queue held back by this worker may go on */
+  if (worker->workers && (worker->pending.length < worker->workers->backlog))
+    {
+      worker->workers->overloaded = FALSE;
+
+      if (worker->workers->watcher->queue)
+        queue_resume(worker->workers->watcher->queue);
+    }
+}
+
+workers_t *
+workers_new(watcher_t *watcher, guint n_workers, guint framing, guint backlog)
+{
+  workers_t *workers;
+  worker_t *worker;
+  guint i;
+
+  workers = g_new0(workers_t, 1);
+  workers->watcher = watcher;
+  workers->n_workers = n_workers;
+  workers->framing = framing;
+  workers->backlog = MAX(backlog, 1);
+  workers->workers = g_new0(worker_t *, n_workers);
+
+  for (i = 0; i < n_workers; i++)
+    {
+      worker = g_new0(worker_t, 1);
+      worker->workers = workers;
+      worker->id = i + 1;
+      worker->in_fd = -1;
+      worker->out_fd = -1;
+      worker->output = g_string_new(NULL);
+      worker->acks = g_string_new(NULL);
+      g_queue_init(&worker->pending);
+      g_queue_init(&worker->inflight);
+
+      workers->workers[i] = worker;
+
+      if (!worker_start(worker))
+        worker->restart_source = g_timeout_add_seconds(WORKERS_RESTART_DELAY,
+            worker_restart, worker);
+    }
+
+  return workers;
+}
+
+void
+workers_free(workers_t *workers)
+{
+  worker_t *worker;
+  guint i;
+
+  if (!workers)
+    return;
+
+  workers_list(workers);
+
+  for (i = 0; i < workers->n_workers; i++)
+    {
+      worker = workers->workers[i];
+
+      if (worker->restart_source)
+        g_source_remove(worker->restart_source);
+
+      if (worker->pending.length + worker->inflight.length > 0)
+        LOG_INFO("%s: %s (worker=%d, records=%d)",
+            workers->watcher->name, N_("dropping unacknowledged records"),
+            worker->id, worker->pending.length + worker->inflight.length);
+
+      /* closing the input asks the worker to exit */
+      worker_close(worker);
+
+      if (worker->pid)
+        {
+          worker->workers = NULL;
+
+          kill(worker->pid, SIGTERM);
+        }
+      else
+        {
+          worker_free(worker);
+        }
+    }
+
+  g_free(workers->workers);
+  g_free(workers);
+}
+
+static worker_t *
+workers_get_worker(const workers_t *workers, const gchar *file)
+{
+  return workers->workers[g_str_hash(file) % workers->n_workers];
+}
+
+gboolean
+workers_is_busy(const workers_t *workers, const gchar *file)
+{
+  return workers_get_worker(workers, file)->pending.length
+      >= workers->backlog;
+}
+
+void
+workers_push(workers_t *workers, const watcher_event_t *event)
+{
+  worker_t *worker;
+
+  worker = workers_get_worker(workers, event->file);
+
+  /* the block policy never loses an event */
+  if ((worker->pending.length >= workers->backlog)
+      && (workers->watcher->queue_policy != QUEUE_POLICY_BLOCK))
+    {
+      if (!workers->overloaded)
+        {
+          LOG_ERROR("%s: %s (worker=%d, backlog=%u)",
+              workers->watcher->name, N_("worker busy, dropping events"),
+              worker->id, workers->backlog);
+
+          workers->overloaded = TRUE;
+        }
+
+      workers->dropped++;
+
+      if (workers->watcher->queue_policy != QUEUE_POLICY_DROP_OLDEST)
+        {
+          LOG_DEBUG("%s: %s (event=%s, file=%s)",
+              workers->watcher->name, N_("event dropped"), event->event,
+              event->file);
+
+          return;
+        }
+
+      g_free(g_queue_pop_head(&worker->pending));
+    }
+
+  g_queue_push_tail(&worker->pending,
+      g_strconcat(event->event, "\t", event->file, NULL));
+
+  worker_schedule(worker);
+}
+
+void
+workers_list(const workers_t *workers)
+{
+  worker_t *worker;
+  guint i;
+
+  LOG_INFO("%s: %s (sent=%" G_GUINT64_FORMAT
+      ", acknowledged=%" G_GUINT64_FORMAT ", dropped=%" G_GUINT64_FORMAT
+      ", restarts=%" G_GUINT64_FORMAT ")",
+      workers->watcher->name, N_("workers"), workers->sent, workers->acked,
+      workers->dropped, workers->restarts);
+
+  for (i = 0; i < workers->n_workers; i++)
+    {
+      worker = workers->workers[i];
+
+      LOG_INFO("%s: +-- worker=%d, pid=%d, pending=%d, inflight=%d",
+          workers->watcher->name, worker->id, worker->pid,
+          worker->pending.length, worker->inflight.length);
+    }
+}
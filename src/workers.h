@@ -0,0 +1,76 @@
+/*
+ * fmon - a file monitoring tool
+ *
+ * Copyright 2011 Boris HUISGEN <bhuisgen@hbis.fr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef WORKERS_H_
+#define WORKERS_H_
+
+#include "common.h"
+
+struct _watcher_t;
+struct _watcher_event_t;
+
+typedef struct _worker_t
+{
+  struct _workers_t *workers;
+  guint id;
+  GPid pid;
+  gint in_fd;
+  gint out_fd;
+  guint in_source;
+  guint out_source;
+  guint child_source;
+  guint restart_source;
+  GString *output;
+  gsize offset;
+  GQueue pending;
+  GQueue inflight;
+  GString *acks;
+} worker_t;
+
+typedef struct _workers_t
+{
+  struct _watcher_t *watcher;
+  worker_t **workers;
+  guint n_workers;
+  guint framing;
+#define WORKERS_FRAMING_NEWLINE         0
+#define WORKERS_FRAMING_NULL            1
+#define WORKERS_FRAMING_LENGTH          2
+  guint backlog;
+  gboolean overloaded;
+  guint64 sent;
+  guint64 acked;
+  guint64 dropped;
+  guint64 restarts;
+} workers_t;
+
+workers_t *
+workers_new(struct _watcher_t *watcher, guint n_workers, guint framing,
+    guint backlog);
+void
+workers_free(workers_t *workers);
+gboolean
+workers_is_busy(const workers_t *workers, const gchar *file);
+void
+workers_push(workers_t *workers, const struct _watcher_event_t *event);
+void
+workers_list(const workers_t *workers);
+
+#endif /* WORKERS_H_ */